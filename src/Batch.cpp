@@ -0,0 +1,255 @@
+/**
+ * Project: EDEF
+ * @file Batch.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for pipelined application of filter on many images.
+ */
+
+#include "Batch.h"
+#include "BoundedQueue.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/**
+ * Image that goes through the pipeline.
+ */
+struct BatchItem {
+	uint64_t job;	//! index of job
+	Image img;	//! decoded image
+	uint64_t width;	//! image width
+	uint64_t height;	//! image height
+	std::vector<uint8_t> res;	//! filtered image
+};
+
+typedef std::chrono::steady_clock BatchClock;
+
+/**
+ * Seconds since given time point.
+ *
+ * @param[in] from
+ * 	The time point.
+ * @return Elapsed seconds.
+ */
+static double secondsSince(const BatchClock::time_point& from){
+	return std::chrono::duration<double>(BatchClock::now()-from).count();
+}
+
+Batch::Batch(const std::vector<Chromosome>& cascade, unsigned cols, unsigned rows, unsigned threads): cascade(cascade), cols(cols), rows(rows){
+	decoders=std::max(1u, threads/4);
+	encoders=std::max(1u, threads/4);
+	filters=threads>decoders+encoders ? threads-decoders-encoders : 1;
+}
+
+uint64_t Batch::run(const std::vector<Job>& jobs){
+	//filter is compiled only once, all filter threads share it
+	std::vector<CGP::Program> programs;
+	for(const Chromosome& c : cascade) programs.push_back(CGP::compile(c));
+
+	BoundedQueue<BatchItem*> decoded(QUEUE_CAPACITY);
+	BoundedQueue<BatchItem*> filtered(QUEUE_CAPACITY);
+
+	std::atomic<uint64_t> nextJob(0);
+	std::atomic<uint64_t> failed(0);
+	std::atomic<unsigned> decodersLeft(decoders);
+	std::atomic<unsigned> filtersLeft(filters);
+	std::mutex statsMutex;
+
+	stats.clear();
+	stats.push_back(StageStats{"decode", decoders, 0, 0, 0});
+	stats.push_back(StageStats{"filter", filters, 0, 0, 0});
+	stats.push_back(StageStats{"encode", encoders, 0, 0, 0});
+
+	//adds statistics of one thread
+	auto report=[&](unsigned stage, uint64_t images, double busy, double waiting){
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats[stage].images+=images;
+		stats[stage].busy+=busy;
+		stats[stage].waiting+=waiting;
+	};
+
+	auto fail=[&](uint64_t job, const std::string& msg){
+		std::lock_guard<std::mutex> lock(statsMutex);
+		std::cerr << "Failed " << jobs[job].first << ": " << msg << std::endl;
+		++failed;
+	};
+
+	//blocking queue operations that measure waiting
+	auto push=[](BoundedQueue<BatchItem*>& q, BatchItem* item, double& waiting){
+		if(q.tryPush(item)) return;
+		BatchClock::time_point start=BatchClock::now();
+		q.push(item);
+		waiting+=secondsSince(start);
+	};
+
+	auto pop=[](BoundedQueue<BatchItem*>& q, double& waiting){
+		BatchItem* item;
+		if(q.tryPop(item)) return item;
+		BatchClock::time_point start=BatchClock::now();
+		item=q.pop();
+		waiting+=secondsSince(start);
+		return item;
+	};
+
+	auto decoder=[&](){
+		uint64_t images=0;
+		double busy=0, waiting=0;
+		for(uint64_t j=nextJob++; j<jobs.size(); j=nextJob++){
+			BatchClock::time_point start=BatchClock::now();
+			BatchItem* item=new BatchItem;
+			item->job=j;
+			try{
+				item->img.load(jobs[j].first);
+			}catch(const std::exception& e){
+				fail(j, e.what());
+				delete item;
+				continue;
+			}
+			item->width=item->img.getWidth();
+			item->height=item->img.getHeight();
+			busy+=secondsSince(start);
+			++images;
+			push(decoded, item, waiting);
+		}
+
+		if(--decodersLeft==0){
+			//the last one stops filters
+			for(unsigned i=0; i<filters; ++i) push(decoded, nullptr, waiting);
+		}
+		report(0, images, busy, waiting);
+	};
+
+	auto filter=[&](){
+		uint64_t images=0;
+		double busy=0, waiting=0;
+		CGP cgp(cols, rows);
+		for(BatchItem* item=pop(decoded, waiting); item!=nullptr; item=pop(decoded, waiting)){
+			BatchClock::time_point start=BatchClock::now();
+			if(programs.size()==1){
+				cgp.useFilter(programs[0], item->img, item->res);
+			}else{
+				item->res.resize(item->img.getWidth()*item->img.getHeight());
+				if(!item->res.empty()){
+					cgp.useFilter(programs, &item->img.getPixels()[0], item->img.getWidth(), item->img.getHeight(),
+							&item->res[0]);
+				}
+			}
+			item->img=Image();	//not needed anymore
+			busy+=secondsSince(start);
+			++images;
+			push(filtered, item, waiting);
+		}
+
+		if(--filtersLeft==0){
+			//the last one stops encoders
+			for(unsigned i=0; i<encoders; ++i) push(filtered, nullptr, waiting);
+		}
+		report(1, images, busy, waiting);
+	};
+
+	auto encoder=[&](){
+		uint64_t images=0;
+		double busy=0, waiting=0;
+		for(BatchItem* item=pop(filtered, waiting); item!=nullptr; item=pop(filtered, waiting)){
+			BatchClock::time_point start=BatchClock::now();
+			try{
+				Image res(item->width, item->height, item->res);
+				res.save(jobs[item->job].second);
+				++images;
+			}catch(const std::exception& e){
+				fail(item->job, e.what());
+			}
+			delete item;
+			busy+=secondsSince(start);
+		}
+		report(2, images, busy, waiting);
+	};
+
+	BatchClock::time_point start=BatchClock::now();
+
+	std::vector<std::thread> threads;
+	for(unsigned i=0; i<decoders; ++i) threads.emplace_back(decoder);
+	for(unsigned i=0; i<filters; ++i) threads.emplace_back(filter);
+	for(unsigned i=0; i<encoders; ++i) threads.emplace_back(encoder);
+	for(auto& t : threads) t.join();
+
+	wall=secondsSince(start);
+
+	return failed;
+}
+
+void Batch::printStats(std::ostream& out) const{
+	uint64_t images=stats.empty() ? 0 : stats.back().images;
+	out << "Processed images: " << images << " in " << wall << " s";
+	if(wall>0) out << " (" << images/wall << " images/s)";
+	out << "\n";
+
+	for(const StageStats& s : stats){
+		out << "\tStage " << s.name << " (" << s.threads << " threads): " << s.images << " images, busy "
+				<< s.busy << " s, waiting " << s.waiting << " s";
+		if(s.busy>0) out << ", " << s.images*s.threads/s.busy << " images/s";
+		out << "\n";
+	}
+	out << std::flush;
+}
+
+bool Batch::isDirectory(const std::string& path){
+	struct stat st;
+	return stat(path.c_str(), &st)==0 && S_ISDIR(st.st_mode);
+}
+
+std::string Batch::inDirectory(const std::string& dir, const std::string& path){
+	std::string::size_type pos=path.find_last_of('/');
+	std::string name= pos==std::string::npos ? path : path.substr(pos+1);
+	if(!dir.empty() && dir[dir.size()-1]!='/') return dir+"/"+name;
+	return dir+name;
+}
+
+std::vector<Batch::Job> Batch::listDirectory(const std::string& dir, const std::string& outDir){
+	DIR* d=opendir(dir.c_str());
+	if(d==nullptr) throw std::runtime_error("Could not read directory: "+dir);
+
+	std::vector<Job> jobs;
+	for(struct dirent* e=readdir(d); e!=nullptr; e=readdir(d)){
+		std::string name(e->d_name);
+		std::string lower(name);
+		std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+		if((lower.size()>4 && lower.compare(lower.size()-4, 4, ".jpg")==0)
+				|| (lower.size()>5 && lower.compare(lower.size()-5, 5, ".jpeg")==0)){
+			std::string path(inDirectory(dir, name));
+			jobs.push_back(Job(path, inDirectory(outDir, name)));
+		}
+	}
+	closedir(d);
+
+	std::sort(jobs.begin(), jobs.end());
+	return jobs;
+}
+
+std::vector<Batch::Job> Batch::readManifest(const std::string& manifest, const std::string& outDir){
+	std::ifstream f(manifest);
+	if(!f) throw std::runtime_error("Could not read manifest: "+manifest);
+
+	std::vector<Job> jobs;
+	std::string line;
+	while(std::getline(f, line)){
+		std::istringstream sLine(line);
+		std::string in, out;
+		if(!(sLine >> in)) continue;	//empty line
+		if(!(sLine >> out)) out=inDirectory(outDir, in);
+		jobs.push_back(Job(in, out));
+	}
+	return jobs;
+}
+
+/*** End of file: Batch.cpp ***/
@@ -0,0 +1,135 @@
+/**
+ * Project: EDEF
+ * @file Batch.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for pipelined application of filter on many images.
+ */
+
+#ifndef SRC_BATCH_H_
+#define SRC_BATCH_H_
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <iostream>
+#include <cstdint>
+#include "CGP.h"
+
+/**
+ * Applies one filter on many images.
+ * Work is done by three-stage pipeline (decode, filter, encode). Each stage has its own
+ * threads and stages are connected by bounded lock-free queues, so only few images are in memory.
+ */
+class Batch {
+public:
+	/**
+	 * Input and output path of one image.
+	 */
+	typedef std::pair<std::string, std::string> Job;
+
+	/**
+	 * Statistics of one stage.
+	 */
+	struct StageStats {
+		const char* name;	//! Name of stage.
+		unsigned threads;	//! Number of threads.
+		uint64_t images;	//! Number of processed images.
+		double busy;	//! Time spent by work (seconds, sum of all threads).
+		double waiting;	//! Time spent by waiting for input or for space in output queue (seconds, sum of all threads).
+	};
+
+	/**
+	 * Creates batch.
+	 *
+	 * @param[in] cascade
+	 * 	The filter (or cascade of filters that are applied one after another).
+	 * @param[in] cols
+	 * 	Number of columns of filter.
+	 * @param[in] rows
+	 * 	Number of rows of filter.
+	 * @param[in] threads
+	 * 	Number of threads that will be divided among stages.
+	 */
+	Batch(const std::vector<Chromosome>& cascade, unsigned cols, unsigned rows, unsigned threads);
+
+	/**
+	 * Processes all jobs.
+	 *
+	 * @param[in] jobs
+	 * 	Images that should be processed.
+	 * @return Number of images that failed.
+	 * @throw std::runtime_error When filter could not be compiled.
+	 */
+	uint64_t run(const std::vector<Job>& jobs);
+
+	/**
+	 * Writes statistics of last run.
+	 *
+	 * @param[out] out
+	 * 	Stream for statistics.
+	 */
+	void printStats(std::ostream& out) const;
+
+	/**
+	 * Creates jobs for all jpg images in directory.
+	 *
+	 * @param[in] dir
+	 * 	Input directory.
+	 * @param[in] outDir
+	 * 	Output directory.
+	 * @return Jobs sorted by input path.
+	 * @throw std::runtime_error When directory could not be read.
+	 */
+	static std::vector<Job> listDirectory(const std::string& dir, const std::string& outDir);
+
+	/**
+	 * Creates jobs from manifest file.
+	 * Each line contains input path optionally followed by output path (separated by whitespace).
+	 * When output path is missing, the image is saved to output directory with its original name.
+	 *
+	 * @param[in] manifest
+	 * 	Path to manifest.
+	 * @param[in] outDir
+	 * 	Output directory.
+	 * @return Jobs.
+	 * @throw std::runtime_error When manifest could not be read.
+	 */
+	static std::vector<Job> readManifest(const std::string& manifest, const std::string& outDir);
+
+	/**
+	 * Checks if path is directory.
+	 *
+	 * @param[in] path
+	 * 	The path.
+	 * @return True for directory.
+	 */
+	static bool isDirectory(const std::string& path);
+
+private:
+	static const uint64_t QUEUE_CAPACITY=16;	//! capacity of queues between stages
+
+	const std::vector<Chromosome>& cascade;	//! the filter (cascade of filters)
+	unsigned cols;	//! number of columns of filter
+	unsigned rows;	//! number of rows of filter
+	unsigned decoders;	//! number of decoding threads
+	unsigned filters;	//! number of filtering threads
+	unsigned encoders;	//! number of encoding threads
+	double wall=0;	//! duration of last run (seconds)
+	std::vector<StageStats> stats;	//! statistics of last run
+
+	/**
+	 * Joins directory and file name of path.
+	 *
+	 * @param[in] dir
+	 * 	Directory.
+	 * @param[in] path
+	 * 	Path whose file name is used.
+	 * @return Path to file in directory.
+	 */
+	static std::string inDirectory(const std::string& dir, const std::string& path);
+};
+
+#endif /* SRC_BATCH_H_ */
+
+/*** End of file: Batch.h ***/
@@ -0,0 +1,184 @@
+/**
+ * Project: EDEF
+ * @file BoundedQueue.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for bounded lock-free multi-producer multi-consumer queue.
+ */
+
+#ifndef SRC_BOUNDEDQUEUE_H_
+#define SRC_BOUNDEDQUEUE_H_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue.
+ * Ring of cells with sequence numbers (Dmitry Vyukov's algorithm).
+ * Blocking operations spin and yield for a while when queue is full/empty and then
+ * sleep on condition variable, so long waits do not burn cores.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+	/**
+	 * Creates queue.
+	 *
+	 * @param[in] capacity
+	 * 	Capacity of queue. Must be power of two.
+	 * @throw std::invalid_argument When capacity is not power of two.
+	 */
+	BoundedQueue(uint64_t capacity): cells(capacity), mask(capacity-1), enqueuePos(0), dequeuePos(0){
+		if(capacity<2 || (capacity & (capacity-1))!=0){
+			throw std::invalid_argument("Capacity of queue must be power of two.");
+		}
+		for(uint64_t i=0; i<capacity; ++i){
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	BoundedQueue(const BoundedQueue&)=delete;
+	BoundedQueue& operator=(const BoundedQueue&)=delete;
+
+	/**
+	 * Inserts value if there is space.
+	 *
+	 * @param[in] value
+	 * 	The value.
+	 * @return True when inserted. False when queue is full.
+	 */
+	bool tryPush(const T& value){
+		Cell* cell;
+		uint64_t pos=enqueuePos.load(std::memory_order_relaxed);
+		while(true){
+			cell=&cells[pos & mask];
+			uint64_t seq=cell->sequence.load(std::memory_order_acquire);
+			int64_t diff=static_cast<int64_t>(seq)-static_cast<int64_t>(pos);
+			if(diff==0){
+				if(enqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}else if(diff<0){
+				return false;	//full
+			}else{
+				pos=enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value=value;
+		cell->sequence.store(pos+1, std::memory_order_release);
+		wake(popWaiters, notEmpty);
+		return true;
+	}
+
+	/**
+	 * Takes value if there is some.
+	 *
+	 * @param[out] value
+	 * 	The value.
+	 * @return True when value was taken. False when queue is empty.
+	 */
+	bool tryPop(T& value){
+		Cell* cell;
+		uint64_t pos=dequeuePos.load(std::memory_order_relaxed);
+		while(true){
+			cell=&cells[pos & mask];
+			uint64_t seq=cell->sequence.load(std::memory_order_acquire);
+			int64_t diff=static_cast<int64_t>(seq)-static_cast<int64_t>(pos+1);
+			if(diff==0){
+				if(dequeuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}else if(diff<0){
+				return false;	//empty
+			}else{
+				pos=dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		value=cell->value;
+		cell->sequence.store(pos+mask+1, std::memory_order_release);
+		wake(pushWaiters, notFull);
+		return true;
+	}
+
+	/**
+	 * Inserts value. Waits while queue is full.
+	 *
+	 * @param[in] value
+	 * 	The value.
+	 */
+	void push(const T& value){
+		for(unsigned i=0; i<SPIN_TRIES; ++i){
+			if(tryPush(value)) return;
+			std::this_thread::yield();
+		}
+
+		std::unique_lock<std::mutex> lock(waitMutex);
+		pushWaiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);	//pairs with fence in wake
+		while(!tryPush(value)) notFull.wait(lock);
+		pushWaiters.fetch_sub(1);
+	}
+
+	/**
+	 * Takes value. Waits while queue is empty.
+	 *
+	 * @return The value.
+	 */
+	T pop(){
+		T value;
+		for(unsigned i=0; i<SPIN_TRIES; ++i){
+			if(tryPop(value)) return value;
+			std::this_thread::yield();
+		}
+
+		std::unique_lock<std::mutex> lock(waitMutex);
+		popWaiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);	//pairs with fence in wake
+		while(!tryPop(value)) notEmpty.wait(lock);
+		popWaiters.fetch_sub(1);
+		return value;
+	}
+
+private:
+	static const unsigned SPIN_TRIES=64;	//! failed tries of blocking operation before it sleeps
+
+	/**
+	 * Cell of ring.
+	 */
+	struct Cell {
+		std::atomic<uint64_t> sequence;	//! sequence number of cell
+		T value;	//! stored value
+	};
+
+	std::vector<Cell> cells;	//! the ring
+	const uint64_t mask;	//! capacity-1
+	alignas(64) std::atomic<uint64_t> enqueuePos;	//! position for next push
+	alignas(64) std::atomic<uint64_t> dequeuePos;	//! position for next pop
+	alignas(64) std::atomic<unsigned> pushWaiters{0};	//! number of sleeping push operations
+	std::atomic<unsigned> popWaiters{0};	//! number of sleeping pop operations
+	std::mutex waitMutex;	//! guards sleeping on condition variables
+	std::condition_variable notFull;	//! signaled when value was taken
+	std::condition_variable notEmpty;	//! signaled when value was inserted
+
+	/**
+	 * Wakes sleeping operations after queue was changed.
+	 * Waiter registers itself before it checks the queue and this is called after the change,
+	 * so the fences guarantee that either waiter sees the change or it is woken.
+	 *
+	 * @param[in] waiters
+	 * 	Number of sleeping operations that can continue now.
+	 * @param[in] cond
+	 * 	Condition variable they sleep on.
+	 */
+	void wake(std::atomic<unsigned>& waiters, std::condition_variable& cond){
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(waiters.load(std::memory_order_relaxed)==0) return;
+		std::lock_guard<std::mutex> lock(waitMutex);	//waiter is either before its check or already sleeping
+		cond.notify_all();
+	}
+};
+
+#endif /* SRC_BOUNDEDQUEUE_H_ */
+
+/*** End of file: BoundedQueue.h ***/
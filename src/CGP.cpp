@@ -11,21 +11,47 @@
 #include "CGP.h"
 #include <queue>
 #include <random>
-
-
-
-
-CGP::CGP(const unsigned c, const unsigned r): cols(c), rows(r){
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <cmath>
+#include <unordered_map>
+
+const double CGP::DEFAULT_FUNCTION_COSTS[CGP::FUNCTIONS]={
+		0.5,	//MAX_VAL
+		0.5,	//IDENTITY
+		1,		//INVERSION
+		1,		//BIT_OR
+		2,		//BIT_OR_WITH_INVERSE
+		1,		//BIT_AND
+		2,		//INVERSION_OF_BIT_AND
+		1,		//XOR
+		1,		//DIVIDING_BY_TWO
+		1,		//DIVIDING_BY_FOUR
+		3,		//MULTIPLE_DIVIDE_AND_OR
+		1,		//SUM
+		2,		//SUM_WITH_SATURATION
+		2,		//INT_AVG
+		2,		//MAX
+		2,		//MIN
+		0.5		//DAMAGED
+};
+
+
+CGP::CGP(const unsigned c, const unsigned r): cols(c), rows(r),
+		functionCosts(DEFAULT_FUNCTION_COSTS, DEFAULT_FUNCTION_COSTS+FUNCTIONS){
 	randGen.seed(std::random_device()());
 	calcColVals();
-	outputs.resize(cols*rows);
+	outputs.resize(PARAM_IN+cols*rows);
 }
 
 CGP::CGP(const unsigned c, const unsigned r, const unsigned lBack): cols(c), rows(r), lBack(lBack),
+		functionCosts(DEFAULT_FUNCTION_COSTS, DEFAULT_FUNCTION_COSTS+FUNCTIONS),
 		distFunctions(0,static_cast<unsigned>(Function::DAMAGED)-1){//DAMAGED is last and we do not want to generate it.
 	randGen.seed(std::random_device()());
 	calcColVals();
-	outputs.resize(cols*rows);
+	outputs.resize(PARAM_IN+cols*rows);
 }
 
 inline void CGP::calcColVals(){
@@ -44,46 +70,115 @@ inline void CGP::calcColVals(){
 		for (unsigned k = 0; k < PARAM_IN; k++, j++) //inserting indexes of inputs
 			colVal[i][j] = k;
 
-		for (unsigned k = minidx; k < maxidx; k++, j++) //inserting indexes of posible block outputs
-			colVal[i][j] = k;
+		for (unsigned k = minidx; k < maxidx; k++) //inserting indexes of posible block outputs
+			if(excluded.find(k)==excluded.end()) colVal[i][j++] = k;
+		colVal[i].resize(j);
 
 	}
 }
 
-inline uint8_t CGP::apply(const Chromosome&c, const std::set<unsigned>& usedBlocks, const std::vector<uint8_t>& inputs){
-
-
-	for(auto blockIdx : usedBlocks){
+CGP::Program CGP::compile(const Chromosome& c){
+	Program p;
+	std::set<unsigned> used(usedBlocks(c));
+	if(PARAM_IN+used.size()>std::numeric_limits<uint16_t>::max()){
+		//slots of operations are 16 bit
+		throw std::runtime_error("Filter has too many active blocks for compilation.");
+	}
+	std::vector<uint16_t> slot(PARAM_IN+(c.size()-PARAM_OUT)/CHROMOSOME_BLOCK_SIZE, 0);
+	for(unsigned i=0; i<PARAM_IN; ++i) slot[i]=i;
+
+	//its a set so indexes are sorted so it should be ok
+	//and we will have calculated all outputs in needed order
+	for(auto blockIdx : used){
+		Program::Operation op;
+		op.f=c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2]<FUNCTIONS
+				? c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2] : static_cast<uint8_t>(Function::DAMAGED);
+		unsigned a=arity(static_cast<Function>(op.f));
+		//ignored inputs are connected to the first input slot
+		op.a= a>0 ? slot[c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE]] : 0;
+		op.b= a>1 ? slot[c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+1]] : 0;
+		slot[blockIdx]=p.slots();
+		p.ops.push_back(op);
+	}
 
-		//its a set so indexes are sorted so it should be ok
-		//and we will have calculated all outputs in needed order
+	p.out=slot[c[c.size()-1]];
 
+	//flat areas are common, so results for them are precalculated
+	std::vector<uint8_t> slots(p.slots());
+	for(unsigned v=0; v<256; ++v){
+		std::fill(slots.begin(), slots.begin()+PARAM_IN, v);
+		p.uniform[v]=execute(p, &slots[0]);
+	}
+	return p;
+}
 
-		unsigned out=blockIdx-PARAM_IN;	//block output
+/**
+ * Checks if order of function inputs does not matter.
+ *
+ * @param[in] f
+ * 	The function.
+ * @return True for commutative function.
+ */
+static bool commutative(CGP::Function f){
+	switch (f) {
+		case CGP::Function::BIT_OR:
+		case CGP::Function::BIT_AND:
+		case CGP::Function::INVERSION_OF_BIT_AND:
+		case CGP::Function::XOR:
+		case CGP::Function::SUM:
+		case CGP::Function::SUM_WITH_SATURATION:
+		case CGP::Function::INT_AVG:
+		case CGP::Function::MAX:
+		case CGP::Function::MIN:
+			return true;
+		default:
+			return false;
+	}
+}
 
-		//get inputs
-		unsigned in1=c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE];
-		unsigned in2=c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+1];
-		Function f=static_cast<Function>(c[(blockIdx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2]);
+CGP::MergedProgram CGP::merge(const std::vector<Program>& programs){
+	MergedProgram m;
+	m.uniform.resize(programs.size()*256);
+	std::unordered_map<uint64_t, uint16_t> blocks;	//slot of block by its function and input slots
+
+	for(unsigned i=0; i<programs.size(); ++i){
+		const Program& p=programs[i];
+		std::vector<uint16_t> slot(p.slots());	//slot of program -> slot of merged program
+		for(unsigned s=0; s<PARAM_IN; ++s) slot[s]=s;
+
+		for(unsigned o=0; o<p.ops.size(); ++o){
+			//inputs are blocks that precede, so they are merged already
+			Program::Operation op=p.ops[o];
+			op.a=slot[op.a];
+			op.b=slot[op.b];
+			if(op.a>op.b && commutative(static_cast<Function>(op.f))) std::swap(op.a, op.b);
+
+			uint64_t key=(static_cast<uint64_t>(op.f)<<32) | (static_cast<uint64_t>(op.a)<<16) | op.b;
+			auto block=blocks.find(key);
+			if(block==blocks.end()){
+				block=blocks.insert(std::make_pair(key, static_cast<uint16_t>(m.program.slots()))).first;
+				m.program.ops.push_back(op);
+			}
+			slot[PARAM_IN+o]=block->second;
+		}
 
-		unsigned x,y;
+		m.outs.push_back(slot[p.out]);
+		std::copy(p.uniform, p.uniform+256, &m.uniform[i*256]);
+	}
+	return m;
+}
 
-		if(in1<PARAM_IN){
-			//connected to input
-			x=inputs[in1];
-		}else{
-			x=outputs[in1-PARAM_IN];
-		}
+inline uint8_t CGP::execute(const Program& p, uint8_t* slots){
+	uint8_t* outputs=slots+PARAM_IN;
+	unsigned out=0;	//block output
 
-		if(in2<PARAM_IN){
-			//connected to input
-			y=inputs[in2];
-		}else{
-			y=outputs[in2-PARAM_IN];
-		}
+	for(const Program::Operation& op : p.ops){
+		//get inputs
+		unsigned x=slots[op.a];
+		unsigned y=slots[op.b];
 
 		//evaluate block
-		switch (f) {
+		switch (static_cast<Function>(op.f)) {
 			case Function::MAX_VAL:
 				outputs[out]=std::numeric_limits<uint8_t>::max();
 				break;
@@ -143,22 +238,45 @@ inline uint8_t CGP::apply(const Chromosome&c, const std::set<unsigned>& usedBloc
 				//DAMAGED
 				outputs[out]=0;
 		}
+		++out;
 	}
 
-	if(c[c.size()-1]<PARAM_IN){
-		//get it straight from inputs
-		return inputs[c[c.size()-1]];
-	}else{
-		//get result from calculated output of a block
-		return outputs[c[c.size()-1]-PARAM_IN];
-	}
-
+	return slots[p.out];
 }
 
 void CGP::damageBlock(Chromosome&c, unsigned idx){
 	c[(idx-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2]=static_cast<uint32_t>(Function::DAMAGED);
 }
 
+std::set<unsigned> CGP::damagedBlocks(const Chromosome&c){
+	std::set<unsigned> damagedB;
+	for (unsigned i = 2; i < c.size(); i += CHROMOSOME_BLOCK_SIZE) { //third is function
+		if (c[i] == static_cast<unsigned>(Function::DAMAGED)) {
+			damagedB.insert(i / CHROMOSOME_BLOCK_SIZE + PARAM_IN);
+		}
+	}
+	return damagedB;
+}
+
+bool CGP::avoidsBlocks(const Chromosome&c, const std::set<unsigned>& blocks){
+	std::set<unsigned> used(usedBlocks(c));
+	for(auto b : blocks){
+		if(used.find(b)!=used.end()) return false;
+	}
+	return true;
+}
+
+bool CGP::valid(const Chromosome& c, unsigned cols, unsigned rows){
+	if(c.size()!=static_cast<uint64_t>(CHROMOSOME_BLOCK_SIZE)*cols*rows+PARAM_OUT) return false;
+
+	for(uint64_t block=0; block<static_cast<uint64_t>(cols)*rows; ++block){
+		const uint64_t reachable=PARAM_IN+(block/rows)*rows;	//first slot of its column
+		const uint32_t* genes=&c[block*CHROMOSOME_BLOCK_SIZE];
+		if(genes[0]>=reachable || genes[1]>=reachable || genes[2]>=FUNCTIONS) return false;
+	}
+	return c.back()<PARAM_IN+static_cast<uint64_t>(cols)*rows;
+}
+
 std::set<unsigned> CGP::usedBlocks(const Chromosome&c){
 	std::set<unsigned> used;
 	std::queue<unsigned> process;
@@ -170,8 +288,9 @@ std::set<unsigned> CGP::usedBlocks(const Chromosome&c){
 		if(process.front()>=PARAM_IN){
 			//its block, not just input
 			used.insert(process.front());
-			process.push(c[(process.front()-PARAM_IN)*CHROMOSOME_BLOCK_SIZE]);		//first input
-			process.push(c[(process.front()-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+1]);	//second input
+			unsigned a=arity(static_cast<Function>(c[(process.front()-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2]));
+			if(a>0) process.push(c[(process.front()-PARAM_IN)*CHROMOSOME_BLOCK_SIZE]);		//first input
+			if(a>1) process.push(c[(process.front()-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+1]);	//second input
 		}
 		process.pop();
 	}
@@ -179,76 +298,854 @@ std::set<unsigned> CGP::usedBlocks(const Chromosome&c){
 	return used;
 }
 
+unsigned CGP::arity(Function f){
+	switch (f) {
+		case Function::IDENTITY:
+		case Function::INVERSION:
+		case Function::DIVIDING_BY_TWO:
+		case Function::DIVIDING_BY_FOUR:
+			return 1;
+		case Function::BIT_OR:
+		case Function::BIT_OR_WITH_INVERSE:
+		case Function::BIT_AND:
+		case Function::INVERSION_OF_BIT_AND:
+		case Function::XOR:
+		case Function::MULTIPLE_DIVIDE_AND_OR:
+		case Function::SUM:
+		case Function::SUM_WITH_SATURATION:
+		case Function::INT_AVG:
+		case Function::MAX:
+		case Function::MIN:
+			return 2;
+		default:
+			//MAX_VAL and DAMAGED are constants
+			return 0;
+	}
+}
+
+unsigned CGP::depth(const Chromosome&c){
+	std::set<unsigned> used(usedBlocks(c));
+	std::vector<unsigned> d(PARAM_IN+(c.size()-PARAM_OUT)/CHROMOSOME_BLOCK_SIZE, 0);
+
+	//set is sorted and block inputs have lower indexes
+	for(auto b : used){
+		const uint32_t* g=&c[(b-PARAM_IN)*CHROMOSOME_BLOCK_SIZE];
+		unsigned a=arity(static_cast<Function>(g[2]));
+		unsigned m=0;
+		if(a>0) m=d[g[0]];
+		if(a>1) m=std::max(m, d[g[1]]);
+		d[b]=m+1;
+	}
+
+	return d[c[c.size()-1]];
+}
+
+CGP::Cost CGP::cost(const Chromosome& c) const{
+	std::set<unsigned> used(usedBlocks(c));
+	Cost res;
+	res.blocks=used.size();
+	res.depth=depth(c);
+	res.weighted=0;
+	for(auto b : used){
+		unsigned f=c[(b-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2];
+		if(f>=FUNCTIONS) f=static_cast<unsigned>(Function::DAMAGED);
+		res.weighted+=functionCosts[f];
+	}
+	return res;
+}
+
+CGP::Profile CGP::profile(const Chromosome& c) const{
+	//rough estimates of interpreter overheads
+	static const double WINDOW_CYCLES=9;	//gathering of 3x3 window
+	static const double BLOCK_CYCLES=6;	//iteration over used blocks, decoding and dispatch of one block
+
+	Profile res;
+	res.cost=cost(c);
+	res.histogram.assign(FUNCTIONS, 0);
+
+	std::set<unsigned> used(usedBlocks(c));
+	std::vector<unsigned> lastUse(PARAM_IN+(c.size()-PARAM_OUT)/CHROMOSOME_BLOCK_SIZE, 0);
+	for(auto b : used){
+		const uint32_t* g=&c[(b-PARAM_IN)*CHROMOSOME_BLOCK_SIZE];
+		unsigned f=g[2]<FUNCTIONS ? g[2] : static_cast<unsigned>(Function::DAMAGED);
+		++res.histogram[f];
+
+		unsigned a=arity(static_cast<Function>(f));
+		for(unsigned i=0; i<a; ++i){
+			if(g[i]<PARAM_IN){
+				res.usedInputs.insert(g[i]);
+			}else{
+				lastUse[g[i]]=b;
+			}
+		}
+	}
+	if(c[c.size()-1]<PARAM_IN){
+		res.usedInputs.insert(c[c.size()-1]);
+	}
+
+	//blocks are evaluated in order of indexes, output of block lives until its last use
+	unsigned live=0;
+	res.liveIntermediates=0;
+	for(auto b : used){
+		++live;	//the new one
+		res.liveIntermediates=std::max(res.liveIntermediates, live);
+		for(auto b2 : used){
+			if(b2>=b) break;
+			if(lastUse[b2]==b && b2!=c[c.size()-1]) --live;	//not needed anymore
+		}
+	}
+
+	res.cyclesPerPixel=WINDOW_CYCLES+BLOCK_CYCLES*res.cost.blocks+res.cost.weighted;
+
+	return res;
+}
+
+const char* CGP::functionName(Function f){
+	switch (f) {
+		case Function::MAX_VAL: return "MAX_VAL";
+		case Function::IDENTITY: return "IDENTITY";
+		case Function::INVERSION: return "INVERSION";
+		case Function::BIT_OR: return "BIT_OR";
+		case Function::BIT_OR_WITH_INVERSE: return "BIT_OR_WITH_INVERSE";
+		case Function::BIT_AND: return "BIT_AND";
+		case Function::INVERSION_OF_BIT_AND: return "INVERSION_OF_BIT_AND";
+		case Function::XOR: return "XOR";
+		case Function::DIVIDING_BY_TWO: return "DIVIDING_BY_TWO";
+		case Function::DIVIDING_BY_FOUR: return "DIVIDING_BY_FOUR";
+		case Function::MULTIPLE_DIVIDE_AND_OR: return "MULTIPLE_DIVIDE_AND_OR";
+		case Function::SUM: return "SUM";
+		case Function::SUM_WITH_SATURATION: return "SUM_WITH_SATURATION";
+		case Function::INT_AVG: return "INT_AVG";
+		case Function::MAX: return "MAX";
+		case Function::MIN: return "MIN";
+		default: return "DAMAGED";
+	}
+}
+
+bool CGP::dominates(const ParetoMember& a, const ParetoMember& b){
+	if(a.fitness>b.fitness || a.cost.weighted>b.cost.weighted || a.cost.depth>b.cost.depth){
+		return false;
+	}
+	return a.fitness<b.fitness || a.cost.weighted<b.cost.weighted || a.cost.depth<b.cost.depth;
+}
+
+bool CGP::insertPareto(ParetoFront& archive, const ParetoMember& m){
+	for(const ParetoMember& act : archive){
+		if(dominates(act, m)) return false;
+	}
+
+	//remove dominated and equal ones
+	archive.erase(std::remove_if(archive.begin(), archive.end(), [&m](const ParetoMember& act){
+		return dominates(m, act) || (act.fitness==m.fitness && act.cost.weighted==m.cost.weighted
+				&& act.cost.depth==m.cost.depth);
+	}), archive.end());
+
+	archive.push_back(m);
+	return true;
+}
+
 Image CGP::useFilter(Chromosome c, const Image& img){
-	static std::vector<uint8_t> resImage;	//the cache
-	std::set<unsigned> usedB=usedBlocks(c);
-	useFilter(c, img, resImage, usedB);
+	std::vector<uint8_t> resImage;
+	useFilter(compile(c), img, resImage);
 	return Image(img.getWidth(), img.getHeight(), resImage);
 }
 
-inline void CGP::useFilter(Chromosome c, const Image& img, std::vector<uint8_t>& resImage, const std::set<unsigned>& usedB){
-	std::vector<uint8_t> inputs(PARAM_IN);
+void CGP::filterRow(const Program& p, const uint8_t* above,
+		const uint8_t* row, const uint8_t* below, uint64_t width, uint8_t* out, uint8_t* scratch){
+	filterSpan(p, above, row, below, width, 0, width, out, scratch);
+}
+
+static_assert(CGP::UNIFORM_TILE==sizeof(uint64_t), "Uniform tiles are checked by 64 bit words.");
 
-	const std::vector<uint8_t>& px = img.getPixels();
-	resImage.resize(img.getHeight() * img.getWidth());
+void CGP::filterSpan(const Program& p, const uint8_t* above, const uint8_t* row, const uint8_t* below,
+		uint64_t width, uint64_t from, uint64_t to, uint8_t* out, uint8_t* scratch){
+	if(from>=to) return;
 
-	//do the edges
+	//the edges
 	//we are extending borders
-	for (unsigned y = 0; y < img.getHeight(); ++y) {
-		for (unsigned x = 0; x < img.getWidth(); ++x) {
-
-			unsigned cnt = 0;
-			for (long tmpY = -1; tmpY <= 1; tmpY++) {	// -1 0 1 y offsets
-				long useY = tmpY + y;
-
-				//fix offset according to actual position
-				if (useY < 0)
-					useY = 0;
-				if (useY >= img.getHeight())
-					useY = img.getHeight() - 1;
-
-				for (long tmpX = -1; tmpX <= 1; tmpX++) {	// -1 0 1 x offsets
-					long useX = tmpX+x;
-					//fix offset according to actual position
-					if (useX < 0)
-						useX = 0;
-					if (useX >= img.getWidth())
-						useX = img.getWidth() - 1;
-					inputs[cnt++] = px[useY * img.getWidth() + useX];
-				}
+	for(uint64_t x : {static_cast<uint64_t>(0), width-1}){
+		if(x<from || x>=to) continue;
+		uint64_t left= x>0 ? x-1 : 0;
+		uint64_t right= x+1<width ? x+1 : width-1;
+
+		scratch[0] = above[left];
+		scratch[1] = above[x];
+		scratch[2] = above[right];
+		scratch[3] = row[left];
+		scratch[4] = row[x];
+		scratch[5] = row[right];
+		scratch[6] = below[left];
+		scratch[7] = below[x];
+		scratch[8] = below[right];
+
+		//apply filter on given inputs
+		out[x] = execute(p, scratch);
+		if(width==1) break;
+	}
+
+	//the rest
+	uint64_t x = std::max(from, static_cast<uint64_t>(1));
+	const uint64_t end = std::min(to, width > 0 ? width-1 : 0);	//last pixel is edge
+	while (x < end) {
+		if (x + UNIFORM_TILE <= end) {
+			//all neighbourhoods of tile are uniform when columns x-1..x+UNIFORM_TILE have the same value in all three rows
+			//(checked by two overlapping words of each row)
+			uint64_t v = row[x] * 0x0101010101010101ULL;
+			uint64_t words[6];
+			std::memcpy(&words[0], above + x - 1, 8);
+			std::memcpy(&words[1], above + x + 1, 8);
+			std::memcpy(&words[2], row + x - 1, 8);
+			std::memcpy(&words[3], row + x + 1, 8);
+			std::memcpy(&words[4], below + x - 1, 8);
+			std::memcpy(&words[5], below + x + 1, 8);
+			if (((words[0] ^ v) | (words[1] ^ v) | (words[2] ^ v) | (words[3] ^ v) | (words[4] ^ v) | (words[5] ^ v)) == 0) {
+				std::memset(out + x, p.uniform[row[x]], UNIFORM_TILE);
+				x += UNIFORM_TILE;
+				continue;
 			}
+		}
+
+		//filter whole tile pixel by pixel
+		for (uint64_t tileEnd = std::min(x + UNIFORM_TILE, end); x < tileEnd; ++x) {
+			//get inputs
+			scratch[0] = above[x - 1];
+			scratch[1] = above[x];
+			scratch[2] = above[x + 1];
+			scratch[3] = row[x - 1];
+			scratch[4] = row[x];
+			scratch[5] = row[x + 1];
+			scratch[6] = below[x - 1];
+			scratch[7] = below[x];
+			scratch[8] = below[x + 1];
 
 			//apply filter on given inputs
-			resImage[y * img.getWidth() + x] = apply(c, usedB, inputs);
+			out[x] = execute(p, scratch);
+		}
+	}
+}
+
+/**
+ * Applies filter on rows of image that is stored in memory.
+ * Rows are split among threads of the pool.
+ *
+ * @param[in] p
+ * 	Compiled filter.
+ * @param[in] px
+ * 	Image pixels. Row above first and row below last must be accessible (or be at image border).
+ * @param[in] width
+ * 	Image width.
+ * @param[in] height
+ * 	Image height.
+ * @param[in] first
+ * 	First row that will be filtered.
+ * @param[in] cnt
+ * 	Number of rows that will be filtered.
+ * @param[out] res
+ * 	Result rows (first row of result is row first).
+ * @param[in] pool
+ * 	Threads. (nullptr single thread)
+ * @param[in] scratch
+ * 	Memory for filter inputs and block outputs of single thread.
+ */
+static void filterRows(const CGP::Program& p, const uint8_t* px,
+		uint64_t width, uint64_t height, uint64_t first, uint64_t cnt, uint8_t* res,
+		ThreadPool* pool, std::vector<uint8_t>& scratch){
+
+	if(scratch.size()<p.slots()) scratch.resize(p.slots());
+
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		for (uint64_t y = from; y < to; ++y) {
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+			CGP::filterRow(p, above, row, below, width, &res[(y-first)*width], s);
+		}
+	};
+
+	uint64_t taskRows=CGP::TASK_PIXELS/width;
+	if(taskRows==0) taskRows=1;
+	uint64_t tasks=(cnt+taskRows-1)/taskRows;
+
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		//waking up threads would take longer than the work itself
+		filterBand(first, first+cnt, &scratch[0]);
+		return;
+	}
+
+	//each thread has its own memory for block outputs
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), scratch);
+
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=first+task*taskRows;
+		uint64_t to=std::min(from+taskRows, first+cnt);
+		filterBand(from, to, &scratches[thread][0]);
+	});
+}
+
+/**
+ * Rolling rows of fused cascade of filters.
+ * Level 0 is input image and level l is result of stage l-1. Inner levels keep only three rows
+ * (row y is at position y%3) that are computed on demand, when the level above needs them.
+ */
+struct CascadeLines {
+	const std::vector<CGP::Program>& stages;	//! the filters
+	const uint8_t* px;	//! available rows of input image
+	uint64_t pxFirst;	//! image row of the first available input row
+	uint64_t width;	//! image width
+	uint64_t height;	//! image height
+	uint8_t* scratch;	//! memory for filter inputs and block outputs
+	std::vector<uint8_t> lines;	//! three rows of each inner level
+	std::vector<uint64_t> next;	//! next row of each level that will be computed
+
+	/**
+	 * Prepares rolling rows for computation of result rows from first.
+	 *
+	 * @param[in] stages
+	 * 	The filters.
+	 * @param[in] px
+	 * 	Available rows of input image. Must contain rows first-stages.size() .. (clamped to image).
+	 * @param[in] pxFirst
+	 * 	Image row of the first available input row.
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[in] first
+	 * 	First result row that will be computed.
+	 * @param[in] scratch
+	 * 	Memory for filter inputs and block outputs (slots of the biggest filter).
+	 */
+	CascadeLines(const std::vector<CGP::Program>& stages, const uint8_t* px, uint64_t pxFirst,
+			uint64_t width, uint64_t height, uint64_t first, uint8_t* scratch)
+		: stages(stages), px(px), pxFirst(pxFirst), width(width), height(height), scratch(scratch),
+		  lines(3*(stages.size()-1)*width), next(stages.size(), 0){
+		//each level starts one row above the level it feeds
+		for(uint64_t l=1; l<stages.size(); ++l){
+			uint64_t halo=stages.size()-l;
+			next[l]= first>halo ? first-halo : 0;
+		}
+	}
+
+	/**
+	 * Row of level.
+	 *
+	 * @param[in] level
+	 * 	The level.
+	 * @param[in] y
+	 * 	Image row (must be available).
+	 * @return Pixels of the row.
+	 */
+	const uint8_t* row(uint64_t level, uint64_t y) const {
+		if(level==0) return &px[(y-pxFirst)*width];
+		return &lines[((level-1)*3+y%3)*width];
+	}
+
+	/**
+	 * Computes rows of inner level up to given one.
+	 *
+	 * @param[in] level
+	 * 	The level.
+	 * @param[in] y
+	 * 	Last row that is needed.
+	 */
+	void ensure(uint64_t level, uint64_t y){
+		for(; next[level]<=y; ++next[level]){
+			compute(level, next[level], &lines[((level-1)*3+next[level]%3)*width]);
+		}
+	}
+
+	/**
+	 * Computes one row of level from rows of level below.
+	 *
+	 * @param[in] level
+	 * 	The level (1..stages.size()).
+	 * @param[in] y
+	 * 	Image row.
+	 * @param[out] out
+	 * 	Result row.
+	 */
+	void compute(uint64_t level, uint64_t y, uint8_t* out){
+		uint64_t above= y>0 ? y-1 : y;	//we are extending borders
+		uint64_t below= y+1<height ? y+1 : y;
+		if(level>1) ensure(level-1, below);
+		CGP::filterRow(stages[level-1], row(level-1, above), row(level-1, y), row(level-1, below), width, out, scratch);
+	}
+};
+
+/**
+ * Applies cascade of filters on rows of image.
+ * Rows are split among threads of the pool. Each task computes its own rolling rows, so rows around
+ * the task are computed by both neighbouring tasks.
+ *
+ * @param[in] stages
+ * 	Compiled filters in order of application.
+ * @param[in] px
+ * 	Available rows of input image. Must contain stages.size() rows above first and below last result row
+ * 	(or up to image border).
+ * @param[in] pxFirst
+ * 	Image row of the first available input row.
+ * @param[in] width
+ * 	Image width.
+ * @param[in] height
+ * 	Image height.
+ * @param[in] first
+ * 	First row that will be filtered.
+ * @param[in] cnt
+ * 	Number of rows that will be filtered.
+ * @param[out] res
+ * 	Result rows (first row of result is row first).
+ * @param[in] pool
+ * 	Threads. (nullptr single thread)
+ * @param[in] scratch
+ * 	Memory for filter inputs and block outputs of single thread.
+ */
+static void cascadeRows(const std::vector<CGP::Program>& stages, const uint8_t* px, uint64_t pxFirst,
+		uint64_t width, uint64_t height, uint64_t first, uint64_t cnt, uint8_t* res,
+		ThreadPool* pool, std::vector<uint8_t>& scratch){
+
+	unsigned slots=0;
+	for(const CGP::Program& p : stages) slots=std::max(slots, p.slots());
+	if(scratch.size()<slots) scratch.resize(slots);
+
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		CascadeLines lines(stages, px, pxFirst, width, height, from, s);
+		for(uint64_t y=from; y<to; ++y){
+			lines.compute(stages.size(), y, &res[(y-first)*width]);
+		}
+	};
+
+	uint64_t taskRows=CGP::TASK_PIXELS/width;
+	//rows around task are computed twice, so tasks should be much taller
+	if(taskRows<8*stages.size()) taskRows=8*stages.size();
+	uint64_t tasks=(cnt+taskRows-1)/taskRows;
+
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		filterBand(first, first+cnt, &scratch[0]);
+		return;
+	}
 
-			if (y != 0 && y != img.getHeight() - 1 && x!=img.getWidth()-1){
-				if(img.getWidth()>1){
-					x = img.getWidth() - 2; //jump
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), scratch);
+
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=first+task*taskRows;
+		uint64_t to=std::min(from+taskRows, first+cnt);
+		filterBand(from, to, &scratches[thread][0]);
+	});
+}
+
+void CGP::useFilter(const Program& p, const Image& img, std::vector<uint8_t>& resImage){
+	resImage.resize(img.getHeight() * img.getWidth());
+	if(resImage.empty()) return;
+
+	useFilter(p, &img.getPixels()[0], img.getWidth(), img.getHeight(), &resImage[0]);
+}
+
+void CGP::useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height, uint8_t* res){
+	if(width==0 || height==0) return;
+
+	filterRows(p, px, width, height, 0, height, res, pool, outputs);
+}
+
+uint64_t CGP::useFilter(const Program& p, const uint8_t* px, const uint8_t* prev, uint64_t width, uint64_t height,
+		uint8_t* res){
+	if(width==0 || height==0) return 0;
+	if(outputs.size()<p.slots()) outputs.resize(p.slots());
+
+	const uint64_t blockCols=(width+DIRTY_BLOCK-1)/DIRTY_BLOCK;
+	const uint64_t blockRows=(height+DIRTY_BLOCK-1)/DIRTY_BLOCK;
+	std::vector<uint8_t> dirty(blockCols*blockRows, 0);	//changed blocks
+
+	uint64_t taskRows=TASK_PIXELS/width;
+	if(taskRows==0) taskRows=1;
+	uint64_t tasks=(height+taskRows-1)/taskRows;
+	bool parallel=pool!=nullptr && pool->size()>1 && tasks>1;
+
+	//compares rows of blocks
+	auto compare=[&](uint64_t from, uint64_t to){
+		for(uint64_t y=from; y<to; ++y){
+			const uint8_t* row=&px[y*width];
+			const uint8_t* prevRow=&prev[y*width];
+			uint8_t* dirtyRow=&dirty[(y/DIRTY_BLOCK)*blockCols];
+			for(uint64_t b=0; b<blockCols; ++b){
+				if(dirtyRow[b]) continue;
+				uint64_t x=b*DIRTY_BLOCK;
+				dirtyRow[b]=std::memcmp(row+x, prevRow+x, std::min(DIRTY_BLOCK, width-x))!=0;
+			}
+		}
+	};
+
+	//filters pixels whose neighbourhood touches changed block
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		uint64_t filtered=0;
+		std::vector<uint8_t> cols(blockCols);
+		for(uint64_t y=from; y<to; ++y){
+			//blocks of this row and rows around
+			const uint8_t* d=&dirty[(y/DIRTY_BLOCK)*blockCols];
+			const uint8_t* dAbove=&dirty[((y>0 ? y-1 : y)/DIRTY_BLOCK)*blockCols];
+			const uint8_t* dBelow=&dirty[((y+1<height ? y+1 : y)/DIRTY_BLOCK)*blockCols];
+			for(uint64_t b=0; b<blockCols; ++b) cols[b]=d[b] | dAbove[b] | dBelow[b];
+
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+			for(uint64_t b=0; b<blockCols; ){
+				if(!cols[b]){
+					++b;
+					continue;
 				}
+				//span of changed blocks with one pixel around
+				uint64_t first=b;
+				while(b<blockCols && cols[b]) ++b;
+				uint64_t spanFrom= first>0 ? first*DIRTY_BLOCK-1 : 0;
+				uint64_t spanTo=std::min(b*DIRTY_BLOCK+1, width);
+				filterSpan(p, above, row, below, width, spanFrom, spanTo, &res[y*width], s);
+				filtered+=spanTo-spanFrom;
 			}
+		}
+		return filtered;
+	};
+
+	if(!parallel){
+		compare(0, height);
+		return filterBand(0, height, &outputs[0]);
+	}
 
+	//blocks rows are not split among tasks, so each task writes its own part of dirty
+	uint64_t compareRows=std::max(taskRows/DIRTY_BLOCK, static_cast<uint64_t>(1))*DIRTY_BLOCK;
+	pool->run((height+compareRows-1)/compareRows, [&](uint64_t task, unsigned){
+		compare(task*compareRows, std::min((task+1)*compareRows, height));
+	});
+
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::atomic<uint64_t> filtered(0);
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=task*taskRows;
+		filtered+=filterBand(from, std::min(from+taskRows, height), &scratches[thread][0]);
+	});
+	return filtered;
+}
+
+uint64_t CGP::useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height,
+		const std::vector<Rect>& rois, uint8_t fill, uint8_t* res){
+	if(width==0 || height==0) return 0;
+	if(outputs.size()<p.slots()) outputs.resize(p.slots());
+
+	uint64_t taskRows=TASK_PIXELS/width;
+	if(taskRows==0) taskRows=1;
+	uint64_t tasks=(height+taskRows-1)/taskRows;
+
+	//filters spans of rows covered by regions
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		uint64_t filtered=0;
+		std::vector<std::pair<uint64_t, uint64_t>> spans;
+		for(uint64_t y=from; y<to; ++y){
+			std::memset(&res[y*width], fill, width);
+
+			spans.clear();
+			for(const Rect& r : rois){
+				if(y<r.y || y-r.y>=r.height || r.x>=width) continue;
+				spans.push_back(std::make_pair(r.x, r.x+std::min(r.width, width-r.x)));
+			}
+			if(spans.empty()) continue;
+			std::sort(spans.begin(), spans.end());
+
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+			for(uint64_t i=0; i<spans.size(); ){
+				//merge overlapping spans
+				uint64_t spanFrom=spans[i].first;
+				uint64_t spanTo=spans[i].second;
+				for(++i; i<spans.size() && spans[i].first<=spanTo; ++i) spanTo=std::max(spanTo, spans[i].second);
+
+				filterSpan(p, above, row, below, width, spanFrom, spanTo, &res[y*width], s);
+				filtered+=spanTo-spanFrom;
+			}
 		}
+		return filtered;
+	};
+
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		return filterBand(0, height, &outputs[0]);
 	}
 
-	//the rest
-	for (unsigned y = 1; y < img.getHeight() - 1; ++y) {
-		for (unsigned x = 1; x < img.getWidth() - 1; ++x) {
-			//get inputs
-			inputs[0] = px[x + (y - 1) * img.getWidth() - 1];
-			inputs[1] = px[x + (y - 1) * img.getWidth()];
-			inputs[2] = px[x + (y - 1) * img.getWidth() + 1];
-			inputs[3] = px[x + y*img.getWidth() - 1];
-			inputs[4] = px[x + y*img.getWidth()];
-			inputs[5] = px[x + y*img.getWidth() + 1];
-			inputs[6] = px[x + (y + 1) * img.getWidth() - 1];
-			inputs[7] = px[x + (y + 1) * img.getWidth()];
-			inputs[8] = px[x + (y + 1) * img.getWidth() + 1];
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::atomic<uint64_t> filtered(0);
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=task*taskRows;
+		filtered+=filterBand(from, std::min(from+taskRows, height), &scratches[thread][0]);
+	});
+	return filtered;
+}
 
-			//apply filter on given inputs
-			resImage[y * img.getWidth() + x] = apply(c, usedB, inputs);
+uint64_t CGP::useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height,
+		const uint8_t* mask, uint8_t fill, uint8_t* res){
+	if(width==0 || height==0) return 0;
+	if(outputs.size()<p.slots()) outputs.resize(p.slots());
+
+	const uint64_t tileCols=(width+MASK_TILE-1)/MASK_TILE;
+	const uint64_t tileRows=(height+MASK_TILE-1)/MASK_TILE;
+	std::vector<uint8_t> used(tileCols*tileRows, 0);	//tiles with masked pixels
+
+	uint64_t taskRows=TASK_PIXELS/width;
+	if(taskRows==0) taskRows=1;
+	uint64_t tasks=(height+taskRows-1)/taskRows;
+	bool parallel=pool!=nullptr && pool->size()>1 && tasks>1;
+
+	//finds tiles with masked pixels
+	auto check=[&](uint64_t from, uint64_t to){
+		for(uint64_t y=from; y<to; ++y){
+			const uint8_t* maskRow=&mask[y*width];
+			uint8_t* usedRow=&used[(y/MASK_TILE)*tileCols];
+			for(uint64_t t=0; t<tileCols; ++t){
+				if(usedRow[t]) continue;
+				const uint8_t* m=maskRow+t*MASK_TILE;
+				const uint8_t* end=maskRow+std::min((t+1)*MASK_TILE, width);
+				usedRow[t]=std::find_if(m, end, [](uint8_t v){ return v!=0; })!=end;
+			}
+		}
+	};
+
+	//filters masked pixels
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		uint64_t filtered=0;
+		for(uint64_t y=from; y<to; ++y){
+			const uint8_t* maskRow=&mask[y*width];
+			const uint8_t* usedRow=&used[(y/MASK_TILE)*tileCols];
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+			uint8_t* out=&res[y*width];
+
+			for(uint64_t t=0; t<tileCols; ++t){
+				uint64_t x=t*MASK_TILE;
+				uint64_t end=std::min(x+MASK_TILE, width);
+				if(!usedRow[t]){
+					std::memset(out+x, fill, end-x);
+					continue;
+				}
 
+				while(x<end){
+					uint64_t spanFrom=x;
+					if(maskRow[x]){
+						while(x<end && maskRow[x]) ++x;
+						filterSpan(p, above, row, below, width, spanFrom, x, out, s);
+						filtered+=x-spanFrom;
+					}else{
+						while(x<end && !maskRow[x]) ++x;
+						std::memset(out+spanFrom, fill, x-spanFrom);
+					}
+				}
+			}
 		}
+		return filtered;
+	};
+
+	if(!parallel){
+		check(0, height);
+		return filterBand(0, height, &outputs[0]);
 	}
+
+	//tile rows are not split among tasks, so each task writes its own part of used
+	uint64_t checkRows=std::max(taskRows/MASK_TILE, static_cast<uint64_t>(1))*MASK_TILE;
+	pool->run((height+checkRows-1)/checkRows, [&](uint64_t task, unsigned){
+		check(task*checkRows, std::min((task+1)*checkRows, height));
+	});
+
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::atomic<uint64_t> filtered(0);
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=task*taskRows;
+		filtered+=filterBand(from, std::min(from+taskRows, height), &scratches[thread][0]);
+	});
+	return filtered;
+}
+
+void CGP::useFilter(const Chromosome& c, PGMReader& in, PGMWriter& out){
+	const uint64_t width=in.getWidth();
+	const uint64_t height=in.getHeight();
+	if(width==0 || height==0) return;
+
+	Program p=compile(c);
+
+	uint64_t bandRows=STREAM_BAND_BYTES/width;
+	if(bandRows<2) bandRows=2;
+
+	//band of rows with one row above and one below
+	std::vector<uint8_t> inBand((bandRows+2)*width);
+	std::vector<uint8_t> outBand(bandRows*width);
+
+	uint64_t n=in.readRows(&inBand[width], bandRows);	//rows in band
+	std::copy(&inBand[width], &inBand[2*width], &inBand[0]);	//we are extending borders
+
+	for(uint64_t y=0; y<height; ){
+		//get row below
+		if(y+n<height){
+			in.readRows(&inBand[(n+1)*width], 1);
+		}else{
+			std::copy(&inBand[n*width], &inBand[(n+1)*width], &inBand[(n+1)*width]);
+		}
+
+		//rows are filtered as middle rows of taller image, so rows above and below are used
+		filterRows(p, &inBand[0], width, n+2, 1, n, &outBand[0], pool, outputs);
+		out.writeRows(&outBand[0], n);
+		y+=n;
+		if(y>=height) break;
+
+		//last row becomes row above and row below becomes first row of next band
+		std::copy(&inBand[n*width], &inBand[(n+2)*width], &inBand[0]);
+		n=1+in.readRows(&inBand[2*width], bandRows-1);
+	}
+}
+
+void CGP::useFilter(const std::vector<Program>& stages, const uint8_t* px, uint64_t width, uint64_t height,
+		uint8_t* res){
+	if(width==0 || height==0 || stages.empty()) return;
+
+	cascadeRows(stages, px, 0, width, height, 0, height, res, pool, outputs);
+}
+
+void CGP::useFilter(const std::vector<Chromosome>& stages, PGMReader& in, PGMWriter& out){
+	const uint64_t width=in.getWidth();
+	const uint64_t height=in.getHeight();
+	if(width==0 || height==0 || stages.empty()) return;
+
+	std::vector<Program> programs;
+	for(const Chromosome& c : stages) programs.push_back(compile(c));
+	const uint64_t halo=stages.size();	//each stage needs one more input row above and below band
+
+	uint64_t bandRows=STREAM_BAND_BYTES/width;
+	if(bandRows<2) bandRows=2;
+
+	//band of input rows with halo rows above and below
+	std::vector<uint8_t> inBand((bandRows+2*halo)*width);
+	std::vector<uint8_t> outBand(bandRows*width);
+	uint64_t inFirst=0;	//image row of the first row in inBand
+	uint64_t inRows=0;	//number of rows in inBand
+
+	for(uint64_t y=0; y<height; y+=bandRows){
+		uint64_t n=std::min(bandRows, height-y);
+
+		//rows above halo are not needed anymore
+		uint64_t keep= y>halo ? y-halo : 0;
+		if(keep>inFirst){
+			uint64_t dropped=keep-inFirst;
+			std::copy(inBand.data()+dropped*width, inBand.data()+inRows*width, inBand.data());
+			inRows-=dropped;
+			inFirst=keep;
+		}
+		uint64_t needed=std::min(height, y+n+halo)-inFirst;
+		inRows+=in.readRows(inBand.data()+inRows*width, needed-inRows);
+
+		cascadeRows(programs, inBand.data(), inFirst, width, height, y, n, outBand.data(), pool, outputs);
+		out.writeRows(outBand.data(), n);
+	}
+}
+
+/**
+ * Combines results of ensemble of filters.
+ *
+ * @param[in] combine
+ * 	How results are combined.
+ * @param[in|out] values
+ * 	Results of filters (may be reordered).
+ * @param[in] n
+ * 	Number of results (at least one).
+ * @return Combined result.
+ */
+static inline uint8_t combineValues(CGP::Combine combine, uint8_t* values, unsigned n){
+	switch(combine){
+		case CGP::Combine::MAX:
+			return *std::max_element(values, values+n);
+		case CGP::Combine::MIN:
+			return *std::min_element(values, values+n);
+		case CGP::Combine::MEDIAN:
+			{
+				std::nth_element(values, values+n/2, values+n);
+				unsigned upper=values[n/2];
+				if(n%2==1) return upper;
+				unsigned lower=*std::max_element(values, values+n/2);
+				return (lower+upper)>>1;
+			}
+		default:
+			{
+				//MEAN
+				unsigned sum=0;
+				for(unsigned i=0; i<n; ++i) sum+=values[i];
+				return (sum+n/2)/n;
+			}
+	}
+}
+
+void CGP::useFilter(const std::vector<Program>& ensemble, Combine combine, const uint8_t* px, uint64_t width,
+		uint64_t height, uint8_t* res){
+	if(width==0 || height==0 || ensemble.empty()) return;
+
+	const unsigned n=ensemble.size();
+	unsigned slots=0;
+	for(const Program& p : ensemble) slots=std::max(slots, p.slots());
+	if(outputs.size()<slots) outputs.resize(slots);
+
+	//results for uniform neighbourhoods
+	uint8_t uniform[256];
+	std::vector<uint8_t> results(n);
+	for(unsigned v=0; v<256; ++v){
+		for(unsigned i=0; i<n; ++i) results[i]=ensemble[i].uniform[v];
+		uniform[v]=combineValues(combine, &results[0], n);
+	}
+
+	auto filterBand=[&](uint64_t from, uint64_t to, uint8_t* s){
+		std::vector<uint8_t> values(n);
+		for(uint64_t y=from; y<to; ++y){
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+			uint8_t* out=&res[y*width];
+
+			for(uint64_t x=0; x<width; ++x){
+				uint64_t left= x>0 ? x-1 : 0;
+				uint64_t right= x+1<width ? x+1 : width-1;
+
+				//neighbourhood is loaded once for all filters
+				s[0] = above[left];
+				s[1] = above[x];
+				s[2] = above[right];
+				s[3] = row[left];
+				s[4] = row[x];
+				s[5] = row[right];
+				s[6] = below[left];
+				s[7] = below[x];
+				s[8] = below[right];
+
+				bool same=true;
+				for(unsigned i=1; i<PARAM_IN && same; ++i) same=s[i]==s[0];
+				if(same){
+					out[x]=uniform[s[0]];
+					continue;
+				}
+
+				//execution keeps inputs untouched
+				for(unsigned i=0; i<n; ++i) values[i]=execute(ensemble[i], s);
+				out[x]=combineValues(combine, &values[0], n);
+			}
+		}
+	};
+
+	uint64_t taskRows=TASK_PIXELS/width;
+	if(taskRows==0) taskRows=1;
+	uint64_t tasks=(height+taskRows-1)/taskRows;
+
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		filterBand(0, height, &outputs[0]);
+		return;
+	}
+
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		uint64_t from=task*taskRows;
+		filterBand(from, std::min(from+taskRows, height), &scratches[thread][0]);
+	});
 }
 
 uint64_t CGP::fitness(const Chromosome& c, const std::vector<Image>& train, const std::vector<Image>& trainOut){
@@ -256,16 +1153,14 @@ uint64_t CGP::fitness(const Chromosome& c, const std::vector<Image>& train, cons
 
 	//apply filter on Image
 	//filter interpretation
-	std::set<unsigned> usedB=usedBlocks(c);
-	static std::vector<uint8_t> resImage;	//the cache
-	std::vector<uint8_t> inputs(PARAM_IN);
-
+	Program p=compile(c);
+	std::vector<uint8_t>& resImage=resCache;	//the cache
 
 	unsigned selectedImage=0;
 	for(const Image& img: train){
 		if (img.getHeight() == 0 || img.getWidth() == 0) continue;
-		useFilter(c, img, resImage, usedB);
-		auto pxRight=trainOut[selectedImage].getPixels();
+		useFilter(p, img, resImage);
+		const auto& pxRight=trainOut[selectedImage].getPixels();
 		//evaluate the result
 		for(unsigned y=0; y<img.getHeight(); ++y){
 			for(unsigned x=0; x<img.getWidth(); ++x){
@@ -284,14 +1179,490 @@ uint64_t CGP::fitness(const Chromosome& c, const std::vector<Image>& train, cons
 	return fitness;
 }
 
+/**
+ * Adds error to fitness. Fitness saturates at maximal value.
+ *
+ * @param[in,out] total
+ * 	The fitness.
+ * @param[in] err
+ * 	Added error.
+ */
+static inline void addSaturated(uint64_t& total, uint64_t err){
+	total= err>std::numeric_limits<uint64_t>::max()-total ? std::numeric_limits<uint64_t>::max() : total+err;
+}
+
+/**
+ * Compiles population and merges it into groups.
+ * Whole population is merged into one program, more groups are used only when merged program
+ * would have too many slots.
+ *
+ * @param[in] population
+ * 	Chromosomes for merging.
+ * @param[out] groups
+ * 	Merged programs.
+ * @param[out] groupFirst
+ * 	Index of the first chromosome of each group.
+ * @return Maximal number of slots of a group.
+ */
+static unsigned mergePopulation(const Population& population, std::vector<CGP::MergedProgram>& groups,
+		std::vector<unsigned>& groupFirst){
+	std::vector<CGP::Program> programs;
+	uint64_t groupSlots=CGP::PARAM_IN;	//upper bound of slots of actual group
+	unsigned slots=0;
+	for(unsigned i=0; i<=population.size(); ++i){
+		CGP::Program p;
+		if(i<population.size()) p=CGP::compile(population[i]);
+		if(i==population.size() || groupSlots+p.ops.size()>std::numeric_limits<uint16_t>::max()){
+			if(!programs.empty()){
+				groups.push_back(CGP::merge(programs));
+				groupFirst.push_back(i-programs.size());
+				slots=std::max(slots, groups.back().program.slots());
+			}
+			programs.clear();
+			groupSlots=CGP::PARAM_IN;
+		}
+		if(i==population.size()) break;
+		groupSlots+=p.ops.size();
+		programs.push_back(std::move(p));
+	}
+	return slots;
+}
+
+/**
+ * Adds errors of all merged filters on one neighbourhood.
+ *
+ * @param[in] groups
+ * 	Merged programs.
+ * @param[in] groupFirst
+ * 	Index of the first chromosome of each group.
+ * @param[in] scratch
+ * 	Neighbourhood in first PARAM_IN values, rest is used for block outputs.
+ * @param[in] target
+ * 	Desired value.
+ * @param[in] count
+ * 	Weight of the error.
+ * @param[in,out] err
+ * 	Error of each chromosome.
+ */
+static inline void addErrors(const std::vector<CGP::MergedProgram>& groups, const std::vector<unsigned>& groupFirst,
+		uint8_t* scratch, uint8_t target, uint64_t count, uint64_t* err){
+	bool same=true;
+	for(unsigned in=1; in<CGP::PARAM_IN && same; ++in) same=scratch[in]==scratch[0];
+
+	for(unsigned g=0; g<groups.size(); ++g){
+		const CGP::MergedProgram& m=groups[g];
+		uint64_t* groupErr=err+groupFirst[g];
+		if(same){
+			const uint8_t* uniform=&m.uniform[scratch[0]];
+			for(unsigned k=0; k<m.outs.size(); ++k){
+				groupErr[k]+=count*abs(target-uniform[k*256]);
+			}
+		}else{
+			//execution keeps inputs untouched
+			CGP::execute(m.program, scratch);
+			for(unsigned k=0; k<m.outs.size(); ++k){
+				groupErr[k]+=count*abs(target-scratch[m.outs[k]]);
+			}
+		}
+	}
+}
+
+/**
+ * Adds errors of all merged filters on one tile of training image.
+ *
+ * @param[in] groups
+ * 	Merged programs.
+ * @param[in] groupFirst
+ * 	Index of the first chromosome of each group.
+ * @param[in] img
+ * 	Train image.
+ * @param[in] imgOut
+ * 	Desired result.
+ * @param[in] x0
+ * 	First column of the tile.
+ * @param[in] y0
+ * 	First row of the tile.
+ * @param[in] scratch
+ * 	Memory for filter inputs and block outputs.
+ * @param[in,out] err
+ * 	Error of each chromosome.
+ */
+static void evaluateTile(const std::vector<CGP::MergedProgram>& groups, const std::vector<unsigned>& groupFirst,
+		const Image& img, const Image& imgOut, uint64_t x0, uint64_t y0, uint8_t* scratch, uint64_t* err){
+	const uint64_t width=img.getWidth();
+	const uint64_t height=img.getHeight();
+	const uint8_t* px=&img.getPixels()[0];
+	const uint8_t* pxRight=&imgOut.getPixels()[0];
+	const uint64_t x1=std::min(x0+CGP::EVAL_TILE, width);
+	const uint64_t y1=std::min(y0+CGP::EVAL_TILE, height);
+
+	//the tile stays in cache for all chromosomes
+	for(uint64_t y=y0; y<y1; ++y){
+		const uint8_t* row=&px[y*width];
+		const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+		const uint8_t* below= y+1<height ? row+width : row;
+		const uint8_t* right=&pxRight[y*width];
+
+		for(uint64_t x=x0; x<x1; ++x){
+			uint64_t left= x>0 ? x-1 : 0;
+			uint64_t next= x+1<width ? x+1 : width-1;
+
+			//neighbourhood is loaded once for all chromosomes
+			scratch[0] = above[left];
+			scratch[1] = above[x];
+			scratch[2] = above[next];
+			scratch[3] = row[left];
+			scratch[4] = row[x];
+			scratch[5] = row[next];
+			scratch[6] = below[left];
+			scratch[7] = below[x];
+			scratch[8] = below[next];
+
+			addErrors(groups, groupFirst, scratch, right[x], 1, err);
+		}
+	}
+}
+
+std::vector<uint64_t> CGP::fitness(const Population& population, const std::vector<Image>& train,
+		const std::vector<Image>& trainOut){
+	std::vector<MergedProgram> groups;
+	std::vector<unsigned> groupFirst;
+	unsigned slots=mergePopulation(population, groups, groupFirst);
+	if(outputs.size()<slots) outputs.resize(slots);
+
+	//tiles are processed in bands (rows of tiles), bands of all images are numbered together
+	std::vector<uint64_t> bands(train.size()+1, 0);	//first band of each image
+	for(unsigned i=0; i<train.size(); ++i){
+		bands[i+1]=bands[i]+(train[i].getHeight()+EVAL_TILE-1)/EVAL_TILE;
+	}
+
+	auto evaluateBand=[&](uint64_t band, uint8_t* scratch, uint64_t* err, uint64_t* fitness){
+		unsigned i=std::upper_bound(bands.begin(), bands.end(), band)-bands.begin()-1;
+		for(uint64_t x0=0; x0<train[i].getWidth(); x0+=EVAL_TILE){
+			std::fill(err, err+population.size(), 0);
+			evaluateTile(groups, groupFirst, train[i], trainOut[i], x0, (band-bands[i])*EVAL_TILE, scratch, err);
+			for(unsigned c=0; c<population.size(); ++c) addSaturated(fitness[c], err[c]);
+		}
+	};
+
+	std::vector<uint64_t> fitness(population.size(), 0);
+	std::vector<uint64_t> err(population.size());
+	if(pool==nullptr || pool->size()==1 || bands.back()<2){
+		for(uint64_t band=0; band<bands.back(); ++band){
+			evaluateBand(band, &outputs[0], &err[0], &fitness[0]);
+		}
+		return fitness;
+	}
+
+	//each thread has its own memory and fitness
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::vector<std::vector<uint64_t>> errs(pool->size(), err);
+	std::vector<std::vector<uint64_t>> fitnesses(pool->size(), fitness);
+	pool->run(bands.back(), [&](uint64_t band, unsigned thread){
+		evaluateBand(band, &scratches[thread][0], &errs[thread][0], &fitnesses[thread][0]);
+	});
+	for(const std::vector<uint64_t>& threadFitness : fitnesses){
+		for(unsigned c=0; c<fitness.size(); ++c) addSaturated(fitness[c], threadFitness[c]);
+	}
+	return fitness;
+}
+
+/**
+ * Numbers of first tiles of training images.
+ *
+ * @param[in] train
+ * 	Train images.
+ * @return First tile of each image and number of all tiles at the end.
+ */
+static std::vector<uint64_t> firstTiles(const std::vector<Image>& train){
+	std::vector<uint64_t> first(train.size()+1, 0);
+	for(unsigned i=0; i<train.size(); ++i){
+		first[i+1]=first[i]+((train[i].getWidth()+CGP::EVAL_TILE-1)/CGP::EVAL_TILE)
+				*((train[i].getHeight()+CGP::EVAL_TILE-1)/CGP::EVAL_TILE);
+	}
+	return first;
+}
+
+/**
+ * Finds position of training tile.
+ *
+ * @param[in] first
+ * 	First tile of each image (see firstTiles).
+ * @param[in] train
+ * 	Train images.
+ * @param[in] tile
+ * 	Number of the tile.
+ * @param[out] image
+ * 	Index of image with the tile.
+ * @param[out] x0
+ * 	First column of the tile.
+ * @param[out] y0
+ * 	First row of the tile.
+ */
+static void tilePosition(const std::vector<uint64_t>& first, const std::vector<Image>& train, uint64_t tile,
+		unsigned& image, uint64_t& x0, uint64_t& y0){
+	image=std::upper_bound(first.begin(), first.end(), tile)-first.begin()-1;
+	const uint64_t tilesInRow=(train[image].getWidth()+CGP::EVAL_TILE-1)/CGP::EVAL_TILE;
+	x0=((tile-first[image])%tilesInRow)*CGP::EVAL_TILE;
+	y0=((tile-first[image])/tilesInRow)*CGP::EVAL_TILE;
+}
+
+std::vector<uint64_t> CGP::fitness(const Population& population, const std::vector<Image>& train,
+		const std::vector<Image>& trainOut, const std::vector<uint64_t>& tiles){
+	std::vector<MergedProgram> groups;
+	std::vector<unsigned> groupFirst;
+	unsigned slots=mergePopulation(population, groups, groupFirst);
+	if(outputs.size()<slots) outputs.resize(slots);
+
+	const std::vector<uint64_t> first(firstTiles(train));
+
+	const uint64_t taskTiles=std::max<uint64_t>(1, TASK_PIXELS/(EVAL_TILE*EVAL_TILE));
+	const uint64_t tasks=(tiles.size()+taskTiles-1)/taskTiles;
+
+	auto evaluateTiles=[&](uint64_t task, uint8_t* scratch, uint64_t* err, uint64_t* fitness){
+		for(uint64_t t=task*taskTiles; t<std::min((task+1)*taskTiles, static_cast<uint64_t>(tiles.size())); ++t){
+			unsigned i;
+			uint64_t x0, y0;
+			tilePosition(first, train, tiles[t], i, x0, y0);
+
+			std::fill(err, err+population.size(), 0);
+			evaluateTile(groups, groupFirst, train[i], trainOut[i], x0, y0, scratch, err);
+			for(unsigned c=0; c<population.size(); ++c) addSaturated(fitness[c], err[c]);
+		}
+	};
+
+	std::vector<uint64_t> fitness(population.size(), 0);
+	std::vector<uint64_t> err(population.size());
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		for(uint64_t task=0; task<tasks; ++task){
+			evaluateTiles(task, &outputs[0], &err[0], &fitness[0]);
+		}
+		return fitness;
+	}
+
+	//each thread has its own memory and fitness
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::vector<std::vector<uint64_t>> errs(pool->size(), err);
+	std::vector<std::vector<uint64_t>> fitnesses(pool->size(), fitness);
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		evaluateTiles(task, &scratches[thread][0], &errs[thread][0], &fitnesses[thread][0]);
+	});
+	for(const std::vector<uint64_t>& threadFitness : fitnesses){
+		for(unsigned c=0; c<fitness.size(); ++c) addSaturated(fitness[c], threadFitness[c]);
+	}
+	return fitness;
+}
+
+std::vector<uint64_t> CGP::tileErrors(const Chromosome& c, const std::vector<Image>& train,
+		const std::vector<Image>& trainOut, const std::vector<uint64_t>& tiles){
+	std::vector<MergedProgram> groups(1, merge(std::vector<Program>(1, compile(c))));
+	std::vector<unsigned> groupFirst(1, 0);
+	if(outputs.size()<groups[0].program.slots()) outputs.resize(groups[0].program.slots());
+
+	const std::vector<uint64_t> first(firstTiles(train));
+	std::vector<uint64_t> errors(tiles.size(), 0);
+	auto evaluate=[&](uint64_t t, uint8_t* scratch){
+		unsigned i;
+		uint64_t x0, y0;
+		tilePosition(first, train, tiles[t], i, x0, y0);
+		evaluateTile(groups, groupFirst, train[i], trainOut[i], x0, y0, scratch, &errors[t]);
+	};
+
+	if(pool==nullptr || pool->size()==1 || tiles.size()<2){
+		for(uint64_t t=0; t<tiles.size(); ++t) evaluate(t, &outputs[0]);
+		return errors;
+	}
+
+	//each thread has its own memory, tiles have their own errors
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	pool->run(tiles.size(), [&](uint64_t t, unsigned thread){
+		evaluate(t, &scratches[thread][0]);
+	});
+	return errors;
+}
+
+uint64_t CGP::tiles(const std::vector<Image>& train){
+	return firstTiles(train).back();
+}
+
+std::vector<uint64_t> CGP::fitness(const Population& population, const Samples& samples){
+	std::vector<MergedProgram> groups;
+	std::vector<unsigned> groupFirst;
+	unsigned slots=mergePopulation(population, groups, groupFirst);
+	if(outputs.size()<slots) outputs.resize(slots);
+
+	const uint64_t tasks=(samples.size()+TASK_PIXELS-1)/TASK_PIXELS;
+
+	auto evaluateSamples=[&](uint64_t from, uint64_t to, uint8_t* scratch, uint64_t* err, uint64_t* fitness){
+		std::fill(err, err+population.size(), 0);
+		for(uint64_t i=from; i<to; ++i){
+			std::copy(&samples.windows[i*PARAM_IN], &samples.windows[(i+1)*PARAM_IN], scratch);
+			addErrors(groups, groupFirst, scratch, samples.targets[i], samples.counts[i], err);
+		}
+		for(unsigned c=0; c<population.size(); ++c) addSaturated(fitness[c], err[c]);
+	};
+
+	std::vector<uint64_t> fitness(population.size(), 0);
+	std::vector<uint64_t> err(population.size());
+	if(pool==nullptr || pool->size()==1 || tasks<2){
+		//one task at a time, so the errors of a task can not overflow
+		for(uint64_t task=0; task<tasks; ++task){
+			evaluateSamples(task*TASK_PIXELS, std::min((task+1)*TASK_PIXELS, samples.size()),
+					&outputs[0], &err[0], &fitness[0]);
+		}
+		return fitness;
+	}
+
+	//each thread has its own memory and fitness
+	std::vector<std::vector<uint8_t>> scratches(pool->size(), outputs);
+	std::vector<std::vector<uint64_t>> errs(pool->size(), err);
+	std::vector<std::vector<uint64_t>> fitnesses(pool->size(), fitness);
+	pool->run(tasks, [&](uint64_t task, unsigned thread){
+		evaluateSamples(task*TASK_PIXELS, std::min((task+1)*TASK_PIXELS, samples.size()),
+				&scratches[thread][0], &errs[thread][0], &fitnesses[thread][0]);
+	});
+	for(const std::vector<uint64_t>& threadFitness : fitnesses){
+		for(unsigned c=0; c<fitness.size(); ++c) addSaturated(fitness[c], threadFitness[c]);
+	}
+	return fitness;
+}
+
+/**
+ * Key of training sample (neighbourhood and desired value).
+ */
+struct SampleKey {
+	uint64_t low;	//! First 8 inputs.
+	uint16_t high;	//! Last input and desired value.
+
+	bool operator==(const SampleKey& o) const {
+		return low==o.low && high==o.high;
+	}
+};
+
+/**
+ * Hash of training sample key.
+ */
+struct SampleKeyHash {
+	size_t operator()(const SampleKey& k) const {
+		uint64_t h=(k.low ^ (static_cast<uint64_t>(k.high)<<48) ^ k.high)*0x9E3779B97F4A7C15ULL;
+		return static_cast<size_t>(h ^ (h>>32));
+	}
+};
+
+static_assert(CGP::PARAM_IN==9, "Sample key stores 3x3 neighbourhood.");
+
+bool CGP::compress(const std::vector<Image>& train, const std::vector<Image>& trainOut,
+		Samples& samples){
+	samples=Samples();
+	uint64_t pixels=0;
+	for(const Image& img : train) pixels+=img.getWidth()*img.getHeight();
+	uint64_t maxSamples=pixels/COMPRESS_RATIO;
+	if(maxSamples>COMPRESS_MAX_SAMPLES) maxSamples=COMPRESS_MAX_SAMPLES;
+	std::unordered_map<SampleKey, uint64_t, SampleKeyHash> index;	//index of sample by its key
+
+	for(unsigned i=0; i<train.size(); ++i){
+		const uint64_t width=train[i].getWidth();
+		const uint64_t height=train[i].getHeight();
+		if(width==0 || height==0) continue;
+		const uint8_t* px=&train[i].getPixels()[0];
+		const uint8_t* pxRight=&trainOut[i].getPixels()[0];
+
+		for(uint64_t y=0; y<height; ++y){
+			const uint8_t* row=&px[y*width];
+			const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+			const uint8_t* below= y+1<height ? row+width : row;
+
+			for(uint64_t x=0; x<width; ++x){
+				uint64_t left= x>0 ? x-1 : 0;
+				uint64_t next= x+1<width ? x+1 : width-1;
+
+				uint8_t window[PARAM_IN]={above[left], above[x], above[next],
+						row[left], row[x], row[next],
+						below[left], below[x], below[next]};
+				SampleKey key;
+				memcpy(&key.low, window, sizeof(key.low));
+				key.high=static_cast<uint16_t>(window[8]<<8 | pxRight[y*width+x]);
+
+				auto sample=index.find(key);
+				if(sample!=index.end()){
+					++samples.counts[sample->second];
+					continue;
+				}
+				if(samples.size()>=maxSamples){
+					samples=Samples();	//frees the memory
+					return false;
+				}
+
+				index.insert(std::make_pair(key, samples.size()));
+				samples.windows.insert(samples.windows.end(), window, window+PARAM_IN);
+				samples.targets.push_back(pxRight[y*width+x]);
+				samples.counts.push_back(1);
+			}
+		}
+	}
+	return true;
+}
+
+CGP::Samples CGP::probe(const std::vector<Image>& train, const std::vector<Image>& trainOut, unsigned n,
+		std::mt19937& randGen){
+	std::vector<uint64_t> firstPixels(train.size()+1, 0);	//first pixel of each image, pixels of all images are numbered together
+	for(unsigned i=0; i<train.size(); ++i){
+		firstPixels[i+1]=firstPixels[i]+train[i].getWidth()*train[i].getHeight();
+	}
+	Samples samples;
+	n=std::min<uint64_t>(n, firstPixels.back());
+
+	for(unsigned k=0; k<n; ++k){
+		//one random pixel from each stratum
+		std::uniform_int_distribution<uint64_t> distPixel(firstPixels.back()*k/n, firstPixels.back()*(k+1)/n-1);
+		uint64_t pixel=distPixel(randGen);
+		unsigned i=std::upper_bound(firstPixels.begin(), firstPixels.end(), pixel)-firstPixels.begin()-1;
+		const uint64_t width=train[i].getWidth();
+		const uint64_t height=train[i].getHeight();
+		const uint64_t x=(pixel-firstPixels[i])%width;
+		const uint64_t y=(pixel-firstPixels[i])/width;
+		const uint8_t* row=&train[i].getPixels()[y*width];
+		const uint8_t* above= y>0 ? row-width : row;	//we are extending borders
+		const uint8_t* below= y+1<height ? row+width : row;
+		uint64_t left= x>0 ? x-1 : 0;
+		uint64_t next= x+1<width ? x+1 : width-1;
+
+		uint8_t window[PARAM_IN]={above[left], above[x], above[next],
+				row[left], row[x], row[next],
+				below[left], below[x], below[next]};
+		samples.windows.insert(samples.windows.end(), window, window+PARAM_IN);
+		samples.targets.push_back(trainOut[i].getPixels()[y*width+x]);
+		samples.counts.push_back(1);
+	}
+	return samples;
+}
+
+std::vector<uint64_t> CGP::imageErrors(const Program& p, const std::vector<Image>& test,
+		const std::vector<Image>& testOut){
+	std::vector<uint64_t> errors(test.size(), 0);
+	std::vector<uint8_t>& resImage=resCache;
+
+	for(unsigned i=0; i<test.size(); ++i){
+		if(test[i].getHeight() == 0 || test[i].getWidth() == 0) continue;
+		useFilter(p, test[i], resImage);
+		const auto& pxRight=testOut[i].getPixels();
+		for(uint64_t j=0; j<resImage.size(); ++j){
+			errors[i]+=abs(pxRight[j]-resImage[j]);
+		}
+	}
+	return errors;
+}
+
 inline void CGP::evaluate(const Population& population, uint64_t& bestFitness, unsigned& bestIndex,
-		const std::vector<Image>& train, const std::vector<Image>& trainOut){
+		const std::vector<Image>& train, const std::vector<Image>& trainOut, const Samples* samples){
 	bestFitness=std::numeric_limits<uint64_t>::max();
 	bestIndex=0;
 
 	//evaluate and find the best one
+	std::vector<uint64_t> populationFitness(samples==nullptr ? fitness(population, train, trainOut)
+			: fitness(population, *samples));
 	for(unsigned i=0; i< population.size(); ++i){
-		unsigned actF=fitness(population[i], train, trainOut);
+		uint64_t actF=populationFitness[i];
 		if(actF<bestFitness){	//lower is better
 			bestFitness=actF;
 			bestIndex=i;
@@ -324,58 +1695,215 @@ inline void CGP::mutate(Chromosome& c){
 				c[i]=distFunctions(randGen);
 			}
 		} else {
-			//output mutation
-			c[i]=distOutputs(randGen);
+			//output mutation (excluded blocks are skipped, inputs are never excluded)
+			do{
+				c[i]=distOutputs(randGen);
+			}while(excluded.find(c[i])!=excluded.end());
 		}
 	}
 }
 
+Chromosome CGP::randomChromosome(){
+	Chromosome c;
+	//distribution for connecting outputs
+	std::uniform_int_distribution<std::mt19937::result_type> distOutputs(0,rows*cols+PARAM_IN-1);
+
+	for(unsigned actColumn=0; actColumn< cols; ++actColumn){
+		std::uniform_int_distribution<std::mt19937::result_type> dist(0,colVal[actColumn].size()-1);
+		for (unsigned r = 0; r < rows; ++r) {
+			//one block
+
+			//first input
+			unsigned ra=dist(randGen);
+			c.push_back(colVal[actColumn][ra]);
+			//second input
+			ra=dist(randGen);
+
+			c.push_back(colVal[actColumn][ra]);
+			//function
+
+			if(damaged.find(PARAM_IN+c.size()/CHROMOSOME_BLOCK_SIZE)==damaged.end()){
+				c.push_back(distFunctions(randGen));
+			}else{
+				//block is damaged
+				c.push_back(static_cast<int>(Function::DAMAGED));
+			}
+
+		}
+	}
+
+	//do not forget to connect the outputs
+	for (unsigned j = 0; j < PARAM_OUT; ++j){
+		unsigned out;
+		do{
+			out=distOutputs(randGen);
+		}while(excluded.find(out)!=excluded.end());
+		c.push_back(out);
+	}
+
+	return c;
+}
+
+/**
+ * Dynamic subset selection of training tiles.
+ * Weight of tile is its difficulty (mean error of parent on its pixels, relative to mean of all tiles)
+ * plus square of its age (windows since it was selected, relative to expected number of windows).
+ * Tiles are selected without replacement with probability proportional to weight.
+ */
+class TileSubset {
+public:
+	/**
+	 * Creates empty subset selection (not used).
+	 */
+	TileSubset(){}
+
+	/**
+	 * Creates subset selection for training images.
+	 *
+	 * @param[in] train
+	 * 	Train images.
+	 */
+	TileSubset(const std::vector<Image>& train): difficulty(CGP::tiles(train), 0), age(difficulty.size(), 0),
+			pixels(difficulty.size()){
+		const std::vector<uint64_t> first(firstTiles(train));
+		for(uint64_t t=0; t<pixels.size(); ++t){
+			unsigned i;
+			uint64_t x0, y0;
+			tilePosition(first, train, t, i, x0, y0);
+			pixels[t]=(std::min<uint64_t>(x0+CGP::EVAL_TILE, train[i].getWidth())-x0)
+					*(std::min<uint64_t>(y0+CGP::EVAL_TILE, train[i].getHeight())-y0);
+		}
+	}
+
+	/**
+	 * Checks if selection is used.
+	 *
+	 * @return True when there are no tiles.
+	 */
+	bool empty() const {
+		return difficulty.empty();
+	}
+
+	/**
+	 * Sets difficulty of tiles.
+	 *
+	 * @param[in] tiles
+	 * 	Evaluated tiles.
+	 * @param[in] errors
+	 * 	Error of parent on each of the tiles.
+	 */
+	void update(const std::vector<uint64_t>& tiles, const std::vector<uint64_t>& errors){
+		for(uint64_t t=0; t<tiles.size(); ++t){
+			difficulty[tiles[t]]=static_cast<double>(errors[t])/pixels[tiles[t]];
+		}
+	}
+
+	/**
+	 * Selects subset of tiles for next window.
+	 * Ages of selected tiles are reset, others get older.
+	 *
+	 * @param[in] n
+	 * 	Number of selected tiles.
+	 * @param[in] randGen
+	 * 	Random number generator.
+	 * @return Selected tiles.
+	 */
+	std::vector<uint64_t> select(unsigned n, std::mt19937& randGen){
+		double meanDifficulty=0;
+		for(double d : difficulty) meanDifficulty+=d;
+		meanDifficulty/=difficulty.size();
+		//tile is selected after this number of windows on average
+		const double expectedAge=static_cast<double>(difficulty.size())/n;
+
+		//weighted sampling without replacement: n smallest keys -ln(u)/weight
+		std::uniform_real_distribution<double> distU(0, 1);
+		std::vector<std::pair<double, uint64_t>> keys(difficulty.size());
+		for(uint64_t t=0; t<difficulty.size(); ++t){
+			double relAge=age[t]/expectedAge;
+			double weight=(meanDifficulty>0 ? difficulty[t]/meanDifficulty : 0)+relAge*relAge;
+			weight=std::max(weight, std::numeric_limits<double>::min());
+			keys[t]=std::make_pair(-std::log(1-distU(randGen))/weight, t);
+		}
+		std::nth_element(keys.begin(), keys.begin()+(n-1), keys.end());
+
+		for(double& a : age) ++a;
+		std::vector<uint64_t> selected(n);
+		for(unsigned i=0; i<n; ++i){
+			selected[i]=keys[i].second;
+			age[selected[i]]=0;
+		}
+		return selected;
+	}
+
+private:
+	std::vector<double> difficulty;	//! Mean error of parent on pixels of each tile.
+	std::vector<double> age;	//! Number of windows since each tile was selected.
+	std::vector<uint64_t> pixels;	//! Number of pixels of each tile.
+};
+
 Chromosome CGP::evolve(const unsigned runs,
 			const std::vector<Image>& train, const std::vector<Image>& trainOut){
 
+	if(pyramidLevels>1) return evolvePyramid(runs, train, trainOut);
+
 	uint64_t bestFitness=std::numeric_limits<uint64_t>::max();	//best fitness
 	Chromosome theMVP;	//best chromosome so far
+	lastGenerations=0;
 
+	//pixels with the same neighbourhood and desired value are evaluated only once
+	const Samples* compressed=trainSamples;
+
+	//offspring are compared with parent only on subset of tiles
+	std::vector<uint64_t> tileOrder;
+	if(compressed==nullptr && batchTiles>0 && batchTiles<tiles(train)){
+		tileOrder.resize(tiles(train));
+		for(uint64_t t=0; t<tileOrder.size(); ++t) tileOrder[t]=t;
+		if(verbose) std::cout << "Minibatch of " << batchTiles << " from " << tileOrder.size() << " tiles." << std::endl;
+	}
+	std::vector<uint64_t> batch;
+	const std::vector<uint64_t> allTiles(tileOrder);
+
+	//hopeless offspring are rejected on few samples before evaluation
+	Samples probeSet;
+	if(probeSamples>0) probeSet=probe(train, trainOut, probeSamples, randGen);
+	uint64_t rejected=0;	//offspring rejected by probe in actual run
+	uint64_t offspring=0;	//all offspring in actual run
+	auto screen=[&](Population& population, const Chromosome& parent){
+		offspring+=population.size();
+		if(probeSet.size()==0) return;
+
+		population.push_back(parent);
+		std::vector<uint64_t> probeFitness(fitness(population, probeSet));
+		population.pop_back();
+
+		const double limit=probeTolerance*probeFitness.back()+probeSet.size();
+		unsigned kept=0;
+		for(unsigned i=0; i<population.size(); ++i){
+			if(probeFitness[i]>limit) continue;
+			if(kept!=i) population[kept]=std::move(population[i]);
+			++kept;
+		}
+		rejected+=population.size()-kept;
+		population.resize(kept);
+	};
+	TileSubset subset;	//state of dynamic subset selection
+	if(!tileOrder.empty() && batchSelection==BatchSelection::DSS) subset=TileSubset(train);
 
-	//distribution for connecting outputs
-	std::uniform_int_distribution<std::mt19937::result_type> distOutputs(0,rows*cols+PARAM_IN-1);
 	//run evolution multiple times
-	for (unsigned run=0; run < runs; run++) {
+	for (unsigned run=0; run < runs && bestFitness>targetFitness; run++) {
 		uint64_t bestFitnessRun=std::numeric_limits<uint64_t>::max();	//best fitness
 		Chromosome bestInRun;	//best chromosome so far
-		std::cout << "Evolution run: " << run << std::endl;
+		if(verbose) std::cout << "Evolution run: " << run << std::endl;
 		//create initial population
 		Population population(populationSize);
 
-		for (unsigned i = 0; i < populationSize; i++) {
-			//for i-th chromosome
-			for(unsigned actColumn=0; actColumn< cols; ++actColumn){
-				std::uniform_int_distribution<std::mt19937::result_type> dist(0,colVal[actColumn].size()-1);
-				for (unsigned r = 0; r < rows; ++r) {
-					//one block
-
-					//first input
-					unsigned ra=dist(randGen);
-					population[i].push_back(colVal[actColumn][ra]);
-					//second input
-					ra=dist(randGen);
-
-					population[i].push_back(colVal[actColumn][ra]);
-					//function
-
-					if(damaged.find(PARAM_IN+population[i].size()/CHROMOSOME_BLOCK_SIZE)==damaged.end()){
-						population[i].push_back(distFunctions(randGen));
-					}else{
-						//block is damaged
-						population[i].push_back(static_cast<int>(Function::DAMAGED));
-					}
-
-				}
+		if(seed.empty()){
+			for (unsigned i = 0; i < populationSize; i++) {
+				population[i]=randomChromosome();
 			}
-
-			//do not forget to connect the outputs
-			for (unsigned j = 0; j < PARAM_OUT; ++j)
-				population[i].push_back(distOutputs(randGen));
+		}else{
+			//evolution continues from given parent
+			population.assign(1, seed);
 		}
 
 		//evaluate intial population
@@ -383,40 +1911,111 @@ Chromosome CGP::evolve(const unsigned runs,
 		uint64_t tmpBestFitness;
 		unsigned tmpBestIndex;
 
-		evaluate(population, tmpBestFitness, tmpBestIndex, train, trainOut);
+		evaluate(population, tmpBestFitness, tmpBestIndex, train, trainOut, compressed);
 		if(tmpBestFitness<=bestFitnessRun){
 			bestFitnessRun=tmpBestFitness;
 			bestInRun=population[tmpBestIndex];
 		}
+		population.resize(populationSize);
+
+		//parent that is not evaluated on all tiles (minibatch)
+		Chromosome parent=bestInRun;
+		unsigned batchGenerations=0;	//generations since parent was evaluated on all tiles
+		if(!subset.empty()) subset.update(allTiles, tileErrors(parent, train, trainOut, allTiles));
+		batch.clear();
+		unsigned lastImprovement=0;	//generation of last improvement of best fitness in run
 
 		//evolution
-		for(unsigned actGen=0; actGen<generations; ++actGen){
+		for(unsigned actGen=0; actGen<generations && bestFitnessRun>targetFitness; ++actGen){
+			if(stagnation>0 && actGen-lastImprovement>=stagnation) break;
+			++lastGenerations;
+			if(!tileOrder.empty()){
+				if(batch.empty() || (actGen%std::max(1u, batchWindow))==0){
+					if(subset.empty()){
+						//random tiles for this window (partial shuffle)
+						for(unsigned t=0; t<batchTiles; ++t){
+							std::uniform_int_distribution<uint64_t> distTile(t, tileOrder.size()-1);
+							std::swap(tileOrder[t], tileOrder[distTile(randGen)]);
+						}
+						batch.assign(tileOrder.begin(), tileOrder.begin()+batchTiles);
+					}else{
+						//difficulty of tiles of the last window is known from actual parent
+						if(!batch.empty()) subset.update(batch, tileErrors(parent, train, trainOut, batch));
+						batch=subset.select(batchTiles, randGen);
+					}
+					std::sort(batch.begin(), batch.end());
+				}
+
+				//parent is scored on the same tiles as its offspring (last member)
+				population.resize(populationSize);
+				for (unsigned i=0; i < populationSize;  i++) {
+					population[i]=parent;
+					mutate(population[i]);
+				}
+				screen(population, parent);
+				population.push_back(parent);
+
+				//first of the best wins, so offspring that is as good as parent replaces it
+				std::vector<uint64_t> batchFitness(fitness(population, train, trainOut, batch));
+				parent=population[std::min_element(batchFitness.begin(), batchFitness.end())-batchFitness.begin()];
+
+				if(++batchGenerations<batchReevaluate && actGen+1<generations) continue;
+
+				//drift of the parent is checked on all tiles
+				batchGenerations=0;
+				uint64_t parentFitness=0;
+				if(subset.empty()){
+					parentFitness=fitness(Population(1, parent), train, trainOut)[0];
+				}else{
+					//the pass also refreshes difficulty of all tiles
+					std::vector<uint64_t> errors(tileErrors(parent, train, trainOut, allTiles));
+					for(uint64_t err : errors) addSaturated(parentFitness, err);
+					subset.update(allTiles, errors);
+				}
+				if(parentFitness<=bestFitnessRun){
+					if(parentFitness<bestFitnessRun) lastImprovement=actGen;
+					bestInRun=parent;
+					bestFitnessRun=parentFitness;
+				}else{
+					parent=bestInRun;
+				}
+				continue;
+			}
+
 			//mutate the best
+			population.resize(populationSize);
 			for (unsigned i=0; i < populationSize;  i++) {
 				population[i]=bestInRun;
 				mutate(population[i]);
 			}
+			screen(population, bestInRun);
+			if(population.empty()) continue;
 
 			//evaluate population
 
-			evaluate(population, tmpBestFitness, tmpBestIndex, train, trainOut);
+			evaluate(population, tmpBestFitness, tmpBestIndex, train, trainOut, compressed);
 			if(tmpBestFitness<=bestFitnessRun){
 				//we searched at least as good individual as actual MVP
 				//so change it
 				//(Equal is because of diversity)
+				if(tmpBestFitness<bestFitnessRun) lastImprovement=actGen;
 				bestInRun=population[tmpBestIndex];
 				bestFitnessRun=tmpBestFitness;
 
 			}
 		}
 
-		std::cout << "\tBest fitness in run: " << bestFitnessRun << std::endl;
+		if(verbose && probeSet.size()>0) std::cout << "\tRejected by probe: " << rejected << " of "
+				<< offspring << " offspring" << std::endl;
+		rejected=0;
+		offspring=0;
+		if(verbose) std::cout << "\tBest fitness in run: " << bestFitnessRun << std::endl;
 		if(bestFitnessRun<=bestFitness){
 			theMVP=bestInRun;
 			bestFitness=bestFitnessRun;
 		}
 
-		std::cout << "\tBest fitness so far in all runs: " << bestFitness << std::endl;
+		if(verbose) std::cout << "\tBest fitness so far in all runs: " << bestFitness << std::endl;
 	}
 
 	//the end
@@ -424,5 +2023,226 @@ Chromosome CGP::evolve(const unsigned runs,
 
 }
 
+Chromosome CGP::evolvePyramid(const unsigned runs,
+			const std::vector<Image>& train, const std::vector<Image>& trainOut){
+	//coarse levels of pyramid (full resolution is not copied)
+	std::vector<std::vector<Image>> pyramid(pyramidLevels-1), pyramidOut(pyramidLevels-1);
+	for(unsigned level=0; level+1<pyramidLevels; ++level){
+		const std::vector<Image>& finer= level==0 ? train : pyramid[level-1];
+		const std::vector<Image>& finerOut= level==0 ? trainOut : pyramidOut[level-1];
+		for(unsigned i=0; i<finer.size(); ++i){
+			pyramid[level].push_back(finer[i].downscale());
+			pyramidOut[level].push_back(finerOut[i].downscale());
+		}
+	}
+
+	//target fitness of each level is scaled by its number of pixels (error is summed over pixels)
+	uint64_t pixels=0;
+	for(const Image& img : train) pixels+=static_cast<uint64_t>(img.getWidth())*img.getHeight();
+	std::vector<uint64_t> levelTargets(pyramidLevels-1);
+	for(unsigned level=0; level+1<pyramidLevels; ++level){
+		uint64_t levelPixels=0;
+		for(const Image& img : pyramid[level]) levelPixels+=static_cast<uint64_t>(img.getWidth())*img.getHeight();
+		levelTargets[level]= pixels==0 ? targetFitness
+				: static_cast<uint64_t>(static_cast<double>(targetFitness)*levelPixels/pixels);
+	}
+
+	//remember settings that are changed
+	unsigned origLevels=pyramidLevels;
+	unsigned origGenerations=generations;
+	uint64_t origTarget=targetFitness;
+	Chromosome origSeed(seed);
+	const Samples* origTrainSamples=trainSamples;	//belongs to full resolution only
+
+	uint64_t bestFitness=std::numeric_limits<uint64_t>::max();	//best fitness
+	Chromosome theMVP;	//best chromosome so far
+	uint64_t allGenerations=0;
+	pyramidLevels=1;
+	for (unsigned run=0; run < runs && bestFitness>origTarget; run++) {
+		//each level continues from the best chromosome of coarser one
+		//and all levels share generations of the run
+		seed=origSeed;
+		unsigned remaining=origGenerations;
+		for(unsigned level=origLevels-1; level>0 && remaining>0; --level){
+			if(verbose) std::cout << "Pyramid level: " << level << std::endl;
+			generations=std::min(pyramidGenerations, remaining);
+			stagnation=pyramidStagnation;
+			targetFitness=levelTargets[level-1];
+			trainSamples=nullptr;
+			seed=evolve(1, pyramid[level-1], pyramidOut[level-1]);
+			allGenerations+=lastGenerations;
+			remaining-=static_cast<unsigned>(lastGenerations);
+		}
+
+		//final selection is on full resolution
+		if(verbose) std::cout << "Pyramid level: 0" << std::endl;
+		generations=remaining;
+		stagnation=0;
+		targetFitness=origTarget;
+		trainSamples=origTrainSamples;
+		Chromosome c=evolve(1, train, trainOut);
+		allGenerations+=lastGenerations;
+
+		uint64_t f=fitness(Population(1, c), train, trainOut)[0];
+		if(f<=bestFitness){
+			theMVP=c;
+			bestFitness=f;
+		}
+	}
+
+	pyramidLevels=origLevels;
+	generations=origGenerations;
+	targetFitness=origTarget;
+	seed=origSeed;
+	trainSamples=origTrainSamples;
+	lastGenerations=allGenerations;
+	return theMVP;
+}
+
+CGP::ParetoFront CGP::evolvePareto(const unsigned runs,
+			const std::vector<Image>& train, const std::vector<Image>& trainOut){
+	ParetoFront front;	//merged fronts of all runs
+	lastGenerations=0;
+
+	for (unsigned run=0; run < runs; run++) {
+		if(verbose) std::cout << "Evolution run: " << run << std::endl;
+		ParetoFront archive;
+
+		//initial population
+		for (unsigned i = 0; i < populationSize; i++) {
+			ParetoMember m;
+			m.chromosome=seed.empty() ? randomChromosome() : seed;
+			m.fitness=fitness(m.chromosome, train, trainOut);
+			m.cost=cost(m.chromosome);
+			insertPareto(archive, m);
+		}
+
+		//evolution
+		for(unsigned actGen=0; actGen<generations; ++actGen){
+			++lastGenerations;
+			//select parent from archive
+			std::uniform_int_distribution<std::mt19937::result_type> distParent(0, archive.size()-1);
+			Chromosome parent(archive[distParent(randGen)].chromosome);
+
+			for (unsigned i=0; i < populationSize;  i++) {
+				ParetoMember m;
+				m.chromosome=parent;
+				mutate(m.chromosome);
+				m.fitness=fitness(m.chromosome, train, trainOut);
+				m.cost=cost(m.chromosome);
+				insertPareto(archive, m);
+			}
+		}
+
+		if(verbose) std::cout << "\tPareto front size in run: " << archive.size() << std::endl;
+		for(const ParetoMember& m : archive){
+			insertPareto(front, m);
+		}
+		if(verbose) std::cout << "\tPareto front size in all runs: " << front.size() << std::endl;
+	}
+
+	std::sort(front.begin(), front.end(), [](const ParetoMember& a, const ParetoMember& b){
+		if(a.fitness!=b.fitness) return a.fitness<b.fitness;
+		if(a.cost.weighted!=b.cost.weighted) return a.cost.weighted<b.cost.weighted;
+		return a.cost.depth<b.cost.depth;
+	});
+
+	return front;
+}
+
+Chromosome CGP::shrink(const Chromosome& c, unsigned stagnation, const std::vector<Image>& train){
+	//reference outputs
+	Program p=compile(c);
+	std::vector<std::vector<uint8_t>> ref(train.size());
+	for(unsigned i=0; i<train.size(); ++i){
+		if (train[i].getHeight() == 0 || train[i].getWidth() == 0) continue;
+		useFilter(p, train[i], ref[i]);
+	}
+
+	Chromosome best(c);
+	Cost bestCost=cost(c);
+
+	for(unsigned withoutImprovement=0; withoutImprovement<stagnation; ){
+		bool improved=false;
+		++lastGenerations;
+		for (unsigned i=0; i < populationSize;  i++) {
+			Chromosome offspring(best);
+			mutate(offspring);
+
+			//cheap check first
+			Cost offCost=cost(offspring);
+			bool lower=(offCost.blocks<bestCost.blocks && offCost.weighted<=bestCost.weighted)
+					|| (offCost.weighted<bestCost.weighted && offCost.blocks<=bestCost.blocks);
+			bool equal=offCost.blocks==bestCost.blocks && offCost.weighted==bestCost.weighted;
+			if(!lower && !equal) continue;
+
+			//outputs must stay the same
+			p=compile(offspring);
+			bool same=true;
+			for(unsigned j=0; j<train.size() && same; ++j){
+				if (train[j].getHeight() == 0 || train[j].getWidth() == 0) continue;
+				useFilter(p, train[j], resCache);
+				same=resCache==ref[j];
+			}
+			if(!same) continue;
+
+			best=offspring;
+			bestCost=offCost;
+			improved=improved || lower;
+		}
+
+		if(improved){
+			withoutImprovement=0;
+		}else{
+			++withoutImprovement;
+		}
+	}
+
+	return best;
+}
+
+Population CGP::harden(const Chromosome& c, unsigned alternatives, uint64_t maxFitness, const unsigned runs,
+			const std::vector<Image>& train, const std::vector<Image>& trainOut){
+	Population archive;
+
+	//remember settings that are changed
+	uint64_t origTarget=targetFitness;
+	Chromosome origSeed(seed);
+
+	//blocks that alternatives must not use
+	std::set<unsigned> forbidden(damagedBlocks(c));
+	std::set<unsigned> used(usedBlocks(c));
+	forbidden.insert(used.begin(), used.end());
+
+	seed.clear();
+	targetFitness=maxFitness;
+	while(archive.size()<alternatives && forbidden.size()<rows*cols){
+		//evolution can not connect forbidden blocks, so alternative never depends on them
+		excluded=forbidden;
+		calcColVals();
+		if(verbose) std::cout << "Search for alternative: " << archive.size() << std::endl;
+		Chromosome alt=evolve(runs, train, trainOut);
+		if(fitness(alt, train, trainOut)>maxFitness || !avoidsBlocks(alt, forbidden)){
+			//could not find another one
+			break;
+		}
+
+		used=usedBlocks(alt);
+		//forbidden blocks are not used, so they keep their function from the filter
+		for(auto b : forbidden){
+			alt[(b-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2]=c[(b-PARAM_IN)*CHROMOSOME_BLOCK_SIZE+2];
+		}
+
+		archive.push_back(alt);
+		forbidden.insert(used.begin(), used.end());
+	}
+
+	excluded.clear();
+	calcColVals();
+	targetFitness=origTarget;
+	seed=origSeed;
+
+	return archive;
+}
 
 /*** End of file: CGP.cpp ***/
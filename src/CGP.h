@@ -16,7 +16,10 @@
 #include <random>
 #include <iostream>
 #include <cstdint>
+#include <limits>
 #include "Image.h"
+#include "PGM.h"
+#include "ThreadPool.h"
 
 
 
@@ -59,6 +62,139 @@ public:
 		DAMAGED						//! always 0	MUST STAY LAST IN ENUM
 	};
 
+	/**
+	 * Number of functions (including DAMAGED).
+	 */
+	static const unsigned FUNCTIONS=static_cast<unsigned>(Function::DAMAGED)+1;
+
+	/**
+	 * Default weights of functions for execution cost estimation.
+	 * Approximate number of operations needed for evaluation of one block.
+	 */
+	static const double DEFAULT_FUNCTION_COSTS[FUNCTIONS];
+
+	/**
+	 * Execution cost of a filter.
+	 */
+	struct Cost {
+		unsigned blocks;	//! Number of active blocks.
+		unsigned depth;	//! Length of critical path (in blocks).
+		double weighted;	//! Sum of function weights of active blocks.
+	};
+
+	/**
+	 * Member of Pareto front.
+	 */
+	struct ParetoMember {
+		Chromosome chromosome;	//! The filter.
+		uint64_t fitness;	//! Error on training data.
+		Cost cost;	//! Execution cost.
+	};
+
+	/**
+	 * Non-dominated filters.
+	 */
+	typedef std::vector<ParetoMember> ParetoFront;
+
+	/**
+	 * How subset of training tiles is selected for minibatch evolution.
+	 */
+	enum class BatchSelection {
+		RANDOM, //! Uniformly random tiles.
+		DSS, //! Dynamic subset selection (favours tiles with high error and tiles that were not selected for long time).
+	};
+
+	/**
+	 * How results of ensemble of filters are combined.
+	 */
+	enum class Combine {
+		MAX, //! The highest result.
+		MIN, //! The lowest result.
+		MEDIAN, //! Median of results (average of two middle ones for even number of filters).
+		MEAN //! Rounded mean of results.
+	};
+
+	/**
+	 * Rectangular region of image.
+	 */
+	struct Rect {
+		uint64_t x;	//! Left column.
+		uint64_t y;	//! Top row.
+		uint64_t width;	//! Number of columns.
+		uint64_t height;	//! Number of rows.
+	};
+
+	/**
+	 * Filter compiled for fast application.
+	 * Contains only active blocks in order of evaluation. Inputs of blocks are slots:
+	 * first PARAM_IN slots are filter inputs and slot PARAM_IN+i is output of i-th operation.
+	 */
+	struct Program {
+		/**
+		 * One active block.
+		 */
+		struct Operation {
+			uint8_t f;	//! Function.
+			uint16_t a;	//! Slot of first input.
+			uint16_t b;	//! Slot of second input.
+		};
+
+		std::vector<Operation> ops;	//! Active blocks.
+		unsigned out=0;	//! Slot of filter output.
+		uint8_t uniform[256];	//! Results for neighbourhoods where all inputs have the same value.
+
+		/**
+		 * Number of slots needed for execution.
+		 *
+		 * @return Number of slots.
+		 */
+		unsigned slots() const {
+			return PARAM_IN+ops.size();
+		}
+	};
+
+	/**
+	 * Filters merged into one program (hash-consing).
+	 * Blocks that compute the same function of the same inputs are merged, so each of them
+	 * is executed only once for all the filters.
+	 */
+	struct MergedProgram {
+		Program program;	//! Unique blocks of all filters (Program::out and Program::uniform are not used).
+		std::vector<unsigned> outs;	//! Slot of output of each filter.
+		std::vector<uint8_t> uniform;	//! Program::uniform of each filter (256 values per filter).
+	};
+
+	/**
+	 * Weighted neighbourhoods of training pixels.
+	 * Filter result depends only on 3x3 neighbourhood, so pixels with the same neighbourhood
+	 * and the same desired value have the same error and are stored only once.
+	 */
+	struct Samples {
+		std::vector<uint8_t> windows;	//! PARAM_IN inputs of each sample.
+		std::vector<uint8_t> targets;	//! Desired value of each sample.
+		std::vector<uint64_t> counts;	//! Number of pixels of each sample.
+
+		/**
+		 * Number of samples.
+		 *
+		 * @return Number of samples.
+		 */
+		uint64_t size() const {
+			return targets.size();
+		}
+	};
+
+	/**
+	 * Static performance profile of a filter.
+	 */
+	struct Profile {
+		Cost cost;	//! Execution cost.
+		std::vector<unsigned> histogram;	//! Number of active blocks for each function.
+		unsigned liveIntermediates;	//! Maximal number of block outputs that must be kept at once.
+		std::set<unsigned> usedInputs;	//! Inputs of 3x3 window that are read.
+		double cyclesPerPixel;	//! Estimated cycles per pixel for the interpreter.
+	};
+
 	/**
 	 * CGP initialization.
 	 *
@@ -83,6 +219,25 @@ public:
 
 	/**
 	 * Evolve chromosome.
+	 * Each run starts from random population or from the seed chromosome (if set)
+	 * and ends after given number of generations or when the target fitness is reached.
+	 * When compressed training set is set (see setTrainSamples), it is used instead of training images.
+	 * Otherwise, when batch tiles are set, offspring and their parent are compared only on random
+	 * subset of training tiles that changes each generation. Parent is evaluated on all tiles every
+	 * batchReevaluate generations and it is replaced with the best fully evaluated chromosome
+	 * when it got worse. Subset is kept for batchWindow generations and it is selected according
+	 * to batchSelection. Dynamic subset selection weights each tile with its difficulty (mean error
+	 * of parent on its pixels when it was evaluated last time, relative to mean of all tiles)
+	 * plus squared age (number of windows since it was selected, relative to expected number).
+	 * When probe samples are set, offspring are first evaluated on small probe set (see probe)
+	 * and offspring with error higher than probeTolerance times error of parent (plus 1 for each sample)
+	 * are rejected without evaluation on training images.
+	 * When there are more pyramid levels, each run starts on the coarsest level of image pyramid
+	 * (see Image::downscale) and best chromosome of each level is the seed on the finer one. All levels
+	 * of a run share its generations. Coarse level ends after pyramidGenerations generations, after
+	 * pyramidStagnation generations without improvement (when set) or when it reaches target fitness
+	 * scaled by its number of pixels. The last level is full resolution with the remaining generations,
+	 * so the result is always selected by fitness on training images.
 	 *
 	 * @param[in] runs
 	 * 	Number of evolution runs.
@@ -95,6 +250,88 @@ public:
 	Chromosome evolve(const unsigned runs,
 				const std::vector<Image> & train, const std::vector<Image> & trainOut);
 
+	/**
+	 * Multi-objective evolution.
+	 * Minimizes error together with execution cost (weighted cost of active blocks and critical path depth).
+	 * Each generation mutates random member of Pareto archive and offspring that are not dominated
+	 * are inserted into the archive.
+	 *
+	 * @param[in] runs
+	 * 	Number of evolution runs. Fronts of all runs are merged.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @return Pareto front sorted by fitness.
+	 */
+	ParetoFront evolvePareto(const unsigned runs,
+				const std::vector<Image> & train, const std::vector<Image> & trainOut);
+
+	/**
+	 * Shrinks the filter without changing its behaviour on training data.
+	 * Offspring is accepted only when its outputs on all training images are identical
+	 * and it has fewer active blocks or lower cost (equal cost is accepted because of diversity).
+	 *
+	 * @param[in] c
+	 * 	The filter.
+	 * @param[in] stagnation
+	 * 	Shrinking ends after this number of generations without improvement.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @return Shrinked filter.
+	 */
+	Chromosome shrink(const Chromosome& c, unsigned stagnation, const std::vector<Image> & train);
+
+	/**
+	 * Calculates execution cost of filter.
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @return Cost of the filter.
+	 */
+	Cost cost(const Chromosome& c) const;
+
+	/**
+	 * Calculates static performance profile of filter.
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @return Profile of the filter.
+	 */
+	Profile profile(const Chromosome& c) const;
+
+	/**
+	 * Get name of function.
+	 *
+	 * @param[in] f
+	 * 	The function.
+	 * @return Name of function.
+	 */
+	static const char* functionName(Function f);
+
+	/**
+	 * Searches for alternative implementations of the filter.
+	 * Each alternative has fitness lower or equal to maxFitness and it does not use
+	 * any block used by the filter or by any previously found alternative.
+	 * Search ends when alternative can not be found.
+	 *
+	 * @param[in] c
+	 * 	The filter.
+	 * @param[in] alternatives
+	 * 	Maximal number of alternatives.
+	 * @param[in] maxFitness
+	 * 	Worst acceptable fitness of alternative.
+	 * @param[in] runs
+	 * 	Number of evolution runs for each alternative.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @return Found alternatives.
+	 */
+	Population harden(const Chromosome& c, unsigned alternatives, uint64_t maxFitness, const unsigned runs,
+				const std::vector<Image> & train, const std::vector<Image> & trainOut);
+
 	/**
 	 * Use filter on image.
 	 *
@@ -110,17 +347,259 @@ public:
 
 	/**
 	 * Use filter on image.
+	 * Rows are split among threads of thread pool (if it is set).
 	 *
-	 * @param[in] c
-	 * 	Chromosome representation of filter.
+	 * @param[in] p
+	 * 	Compiled filter.
 	 * @param[in] img
 	 * 	The image for processing.
 	 * @param[out] resImage
 	 *  Result of filter.
-	 * @param[in] usedB
-	 *  Used blocks in chromosome
 	 */
-	void useFilter(Chromosome c, const Image& img, std::vector<uint8_t>& resImage, const std::set<unsigned>& usedB);
+	void useFilter(const Program& p, const Image& img, std::vector<uint8_t>& resImage);
+
+	/**
+	 * Use filter on image in memory.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] px
+	 * 	Pixels of image (one byte per pixel, row by row).
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[out] res
+	 *  Result of filter (width*height).
+	 */
+	void useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height, uint8_t* res);
+
+	/**
+	 * Use filter on frame that differs from previous frame only in some regions.
+	 * Frames are compared in blocks of DIRTY_BLOCK x DIRTY_BLOCK pixels and only pixels whose
+	 * neighbourhood touches changed block are filtered again, the rest of result stays from previous frame.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] px
+	 * 	Pixels of frame (one byte per pixel, row by row).
+	 * @param[in] prev
+	 * 	Pixels of previous frame.
+	 * @param[in] width
+	 * 	Frame width.
+	 * @param[in] height
+	 * 	Frame height.
+	 * @param[in|out] res
+	 *  Result of filter for previous frame, which is updated to result for actual frame (width*height).
+	 * @return Number of filtered pixels.
+	 */
+	uint64_t useFilter(const Program& p, const uint8_t* px, const uint8_t* prev, uint64_t width, uint64_t height,
+			uint8_t* res);
+
+	/**
+	 * Use filter only inside regions of interest.
+	 * Only rows and columns covered by regions are filtered, so compute scales with area of regions.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] px
+	 * 	Pixels of image (one byte per pixel, row by row).
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[in] rois
+	 * 	Regions of interest (they may overlap or exceed the image).
+	 * @param[in] fill
+	 * 	Value of result outside of regions.
+	 * @param[out] res
+	 *  Result of filter (width*height).
+	 * @return Number of filtered pixels.
+	 */
+	uint64_t useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height,
+			const std::vector<Rect>& rois, uint8_t fill, uint8_t* res);
+
+	/**
+	 * Use filter only on masked pixels.
+	 * Mask is checked in tiles of MASK_TILE x MASK_TILE pixels and tiles without masked pixels are just filled.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] px
+	 * 	Pixels of image (one byte per pixel, row by row).
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[in] mask
+	 * 	Mask (width*height). Pixels with nonzero mask are filtered.
+	 * @param[in] fill
+	 * 	Value of result for pixels that are not masked.
+	 * @param[out] res
+	 *  Result of filter (width*height).
+	 * @return Number of filtered pixels.
+	 */
+	uint64_t useFilter(const Program& p, const uint8_t* px, uint64_t width, uint64_t height,
+			const uint8_t* mask, uint8_t fill, uint8_t* res);
+
+	/**
+	 * Use filter on image that is streamed in bands of rows.
+	 * Only band of input rows (with one row above and below) and band of output rows
+	 * are kept in memory.
+	 *
+	 * @param[in] c
+	 * 	Chromosome representation of filter.
+	 * @param[in] in
+	 * 	Source of input image rows.
+	 * @param[out] out
+	 * 	Destination for result rows. (Must have same size as input.)
+	 * @throw std::runtime_error	When image could not be read or written.
+	 */
+	void useFilter(const Chromosome& c, PGMReader& in, PGMWriter& out);
+
+	/**
+	 * Use cascade of filters on image in memory (result of each filter is input of the next one).
+	 * Stages are fused: each stage (but the last one) keeps only three rolling rows of its result
+	 * and the next stage consumes them as soon as they are ready, so no intermediate images are made.
+	 * Result is the same as when filters are used one after another on whole images.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] stages
+	 * 	Compiled filters in order of application.
+	 * @param[in] px
+	 * 	Pixels of image (one byte per pixel, row by row).
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[out] res
+	 *  Result of last filter (width*height).
+	 */
+	void useFilter(const std::vector<Program>& stages, const uint8_t* px, uint64_t width, uint64_t height,
+			uint8_t* res);
+
+	/**
+	 * Use cascade of filters on image that is streamed in bands of rows.
+	 * Same as streamed use of single filter, but bands are extended by one row above and below
+	 * for each stage.
+	 *
+	 * @param[in] stages
+	 * 	Chromosome representations of filters in order of application.
+	 * @param[in] in
+	 * 	Source of input image rows.
+	 * @param[out] out
+	 * 	Destination for result rows. (Must have same size as input.)
+	 * @throw std::runtime_error	When image could not be read or written.
+	 */
+	void useFilter(const std::vector<Chromosome>& stages, PGMReader& in, PGMWriter& out);
+
+	/**
+	 * Use ensemble of filters on image in memory and combine their results.
+	 * All filters are evaluated on each neighbourhood when it is loaded, so image is read only once
+	 * regardless of number of filters. Uniform neighbourhoods are taken from combined Program::uniform tables.
+	 * Rows are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] ensemble
+	 * 	Compiled filters.
+	 * @param[in] combine
+	 * 	How results are combined.
+	 * @param[in] px
+	 * 	Pixels of image (one byte per pixel, row by row).
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[out] res
+	 *  Combined result (width*height).
+	 */
+	void useFilter(const std::vector<Program>& ensemble, Combine combine, const uint8_t* px, uint64_t width,
+			uint64_t height, uint8_t* res);
+
+	/**
+	 * Use filter on one row of image.
+	 * Borders are extended, so for the first row above should be the row itself
+	 * and for the last row below should be the row itself.
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] above
+	 * 	Row above.
+	 * @param[in] row
+	 * 	The row.
+	 * @param[in] below
+	 * 	Row below.
+	 * @param[in] width
+	 * 	Number of pixels in row.
+	 * @param[out] out
+	 * 	Result of filter for the row.
+	 * @param[out] scratch
+	 * 	Memory for filter inputs and block outputs (Program::slots). Each thread needs its own.
+	 */
+	static void filterRow(const Program& p, const uint8_t* above,
+			const uint8_t* row, const uint8_t* below, uint64_t width, uint8_t* out, uint8_t* scratch);
+
+	/**
+	 * Use filter on part of one row of image.
+	 * Same as filterRow, but only pixels from..to-1 are filtered.
+	 * Runs of UNIFORM_TILE pixels whose neighbourhoods are uniform (flat areas) are taken from Program::uniform.
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] above
+	 * 	Row above.
+	 * @param[in] row
+	 * 	The row.
+	 * @param[in] below
+	 * 	Row below.
+	 * @param[in] width
+	 * 	Number of pixels in row.
+	 * @param[in] from
+	 * 	First filtered pixel.
+	 * @param[in] to
+	 * 	Pixel after last filtered one.
+	 * @param[out] out
+	 * 	Result of filter for the row (pixel x is at out[x]).
+	 * @param[out] scratch
+	 * 	Memory for filter inputs and block outputs (Program::slots). Each thread needs its own.
+	 */
+	static void filterSpan(const Program& p, const uint8_t* above, const uint8_t* row, const uint8_t* below,
+			uint64_t width, uint64_t from, uint64_t to, uint8_t* out, uint8_t* scratch);
+
+	/**
+	 * Compiles filter for fast application.
+	 * Slots are 16 bit, so filter can have at most 65535-PARAM_IN active blocks.
+	 *
+	 * @param[in] c
+	 * 	Chromosome representation of filter.
+	 * @return Compiled filter.
+	 * @throw std::runtime_error When filter has too many active blocks.
+	 */
+	static Program compile(const Chromosome& c);
+
+	/**
+	 * Merges compiled filters into one program.
+	 * Inputs of commutative functions are ordered, so blocks that differ only in order of inputs are merged too.
+	 *
+	 * @param[in] programs
+	 * 	Compiled filters. Merged program must have less than 65536 slots.
+	 * @return Merged program.
+	 */
+	static MergedProgram merge(const std::vector<Program>& programs);
+
+	/**
+	 * Executes compiled filter.
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in|out] slots
+	 * 	Memory with filter inputs at first PARAM_IN positions. Rest is used for block outputs.
+	 * @return Result of filter
+	 */
+	static uint8_t execute(const Program& p, uint8_t* slots);
 
 	/**
 	 * Calculates fitness for given chromosome.
@@ -135,8 +614,156 @@ public:
 	 */
 	uint64_t fitness(const Chromosome& c, const std::vector<Image>& train,
 			const std::vector<Image>& trainOut);
+
+	/**
+	 * Calculates fitness of whole population at once.
+	 * Training images are swept only once in tiles of EVAL_TILE x EVAL_TILE pixels and all chromosomes
+	 * are evaluated on the tile while it is in cache, so training pixels are not streamed from memory
+	 * for each chromosome. Chromosomes are merged (see merge), so blocks shared by offspring of the same
+	 * parent are executed only once for each pixel.
+	 * Result for each chromosome is the same as from fitness(c, train, trainOut).
+	 * Tiles are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] population
+	 * 	Chromosomes for fitness checking.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @return Fitness of each chromosome.
+	 */
+	std::vector<uint64_t> fitness(const Population& population, const std::vector<Image>& train,
+			const std::vector<Image>& trainOut);
+
+	/**
+	 * Calculates fitness of whole population on subset of training tiles.
+	 * Training images are split into tiles of EVAL_TILE x EVAL_TILE pixels (smaller on the right and bottom
+	 * border). Tiles are numbered row by row and images one after another (see tiles).
+	 * Result for all tiles is the same as from fitness(population, train, trainOut).
+	 * Tiles are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] population
+	 * 	Chromosomes for fitness checking.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @param[in] tiles
+	 * 	Numbers of evaluated tiles.
+	 * @return Fitness of each chromosome on given tiles.
+	 */
+	std::vector<uint64_t> fitness(const Population& population, const std::vector<Image>& train,
+			const std::vector<Image>& trainOut, const std::vector<uint64_t>& tiles);
+
+	/**
+	 * Calculates error of chromosome on each of given training tiles.
+	 * Tiles are numbered as in fitness(population, train, trainOut, tiles).
+	 * Tiles are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] c
+	 * 	Chromosome for fitness checking.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @param[in] tiles
+	 * 	Numbers of evaluated tiles.
+	 * @return Sum of absolute differences on each tile.
+	 */
+	std::vector<uint64_t> tileErrors(const Chromosome& c, const std::vector<Image>& train,
+			const std::vector<Image>& trainOut, const std::vector<uint64_t>& tiles);
+
+	/**
+	 * Number of tiles of EVAL_TILE x EVAL_TILE pixels in training images.
+	 *
+	 * @param[in] train
+	 * 	Train images.
+	 * @return Number of tiles.
+	 */
+	static uint64_t tiles(const std::vector<Image>& train);
+
+	/**
+	 * Calculates fitness of whole population on weighted samples.
+	 * Result for each chromosome is the same as from fitness(c, train, trainOut) when samples
+	 * were created from train and trainOut by compress.
+	 * Samples are split among threads of thread pool (if it is set).
+	 *
+	 * @param[in] population
+	 * 	Chromosomes for fitness checking.
+	 * @param[in] samples
+	 * 	Training samples.
+	 * @return Fitness of each chromosome.
+	 */
+	std::vector<uint64_t> fitness(const Population& population, const Samples& samples);
+
+	/**
+	 * Selects probe samples from training images.
+	 * Pixels are stratified, so they are spread over all images.
+	 *
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @param[in] n
+	 * 	Number of samples (lower when there are not enough pixels).
+	 * @param[in] randGen
+	 * 	Random number generator.
+	 * @return The samples (each with count 1).
+	 */
+	static Samples probe(const std::vector<Image>& train, const std::vector<Image>& trainOut, unsigned n,
+			std::mt19937& randGen);
+
+	/**
+	 * Compresses training images into unique pairs of neighbourhood and desired value.
+	 *
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * Compression stops (and samples are freed) when there are more unique samples than
+	 * 1/COMPRESS_RATIO of training pixels or COMPRESS_MAX_SAMPLES, because it does not pay off
+	 * or it would need too much memory.
+	 *
+	 * @param[out] samples
+	 * 	Unique samples with their counts.
+	 * @return False when compression was stopped.
+	 */
+	static bool compress(const std::vector<Image>& train, const std::vector<Image>& trainOut,
+			Samples& samples);
+
+	/**
+	 * Calculates error of compiled filter on each image.
+	 * Unlike fitness, errors of images are kept apart (fitness is their sum).
+	 *
+	 * @param[in] p
+	 * 	Compiled filter.
+	 * @param[in] test
+	 * 	Images that will be used as input for filter.
+	 * @param[in] testOut
+	 * 	Desired results.
+	 * @return Sum of absolute differences of each image.
+	 */
+	std::vector<uint64_t> imageErrors(const Program& p, const std::vector<Image>& test,
+			const std::vector<Image>& testOut);
+
+	/**
+	 * Checks if chromosome is valid filter with given dimensions.
+	 * Blocks can be connected only to inputs and to blocks in previous columns, output to any
+	 * input or block and each function must exist.
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @param[in] cols
+	 * 	Number of columns.
+	 * @param[in] rows
+	 * 	Number of rows.
+	 * @return True for valid chromosome.
+	 */
+	static bool valid(const Chromosome& c, unsigned cols, unsigned rows);
+
 	/**
 	 * Get used blocks in chromosome.
+	 * Inputs that are ignored by block function are not followed.
 	 *
 	 * @param[in] c
 	 * 	Chromosome.
@@ -144,6 +771,57 @@ public:
 	 */
 	static std::set<unsigned> usedBlocks(const Chromosome&c);
 
+	/**
+	 * Get number of inputs that function really uses.
+	 *
+	 * @param[in] f
+	 * 	The function.
+	 * @return Number of used inputs (first inputs are used).
+	 */
+	static unsigned arity(Function f);
+
+	/**
+	 * Length of critical path from filter inputs to its output.
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @return Critical path depth in blocks.
+	 */
+	static unsigned depth(const Chromosome&c);
+
+	/**
+	 * Checks if a dominates b.
+	 * a is not worse in all objectives and better in at least one of them.
+	 *
+	 * @param[in] a
+	 * 	First member.
+	 * @param[in] b
+	 * 	Second member.
+	 * @return True when a dominates b.
+	 */
+	static bool dominates(const ParetoMember& a, const ParetoMember& b);
+
+	/**
+	 * Get damaged blocks in chromosome.
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @return Indexes of damaged blocks. (first block index is PARAM_IN)
+	 */
+	static std::set<unsigned> damagedBlocks(const Chromosome&c);
+
+	/**
+	 * Checks if filter does not use any of given blocks.
+	 * Used block that is damaged in the chromosome is still used (as constant 0).
+	 *
+	 * @param[in] c
+	 * 	Chromosome.
+	 * @param[in] blocks
+	 * 	Indexes of blocks. (first block index is PARAM_IN)
+	 * @return True when filter does not depend on given blocks.
+	 */
+	static bool avoidsBlocks(const Chromosome&c, const std::set<unsigned>& blocks);
+
 	/**
 	 * Damages block on given index.
 	 *
@@ -185,6 +863,14 @@ public:
 		return rows;
 	}
 
+	const std::vector<double>& getFunctionCosts() const {
+		return functionCosts;
+	}
+
+	void setFunctionCosts(const std::vector<double>& functionCosts) {
+		this->functionCosts = functionCosts;
+	}
+
 	void setRows(unsigned rows) {
 		this->rows = rows;
 		calcColVals();
@@ -194,6 +880,20 @@ public:
 		return damaged;
 	}
 
+	ThreadPool* getThreadPool() const {
+		return pool;
+	}
+
+	/**
+	 * Sets threads for filter application (useFilter).
+	 *
+	 * @param[in] pool
+	 * 	The pool. nullptr means single thread.
+	 */
+	void setThreadPool(ThreadPool* pool) {
+		this->pool = pool;
+	}
+
 	void setDamaged(const std::set<unsigned>& damaged) {
 		this->damaged = damaged;
 	}
@@ -214,9 +914,139 @@ public:
 		this->generations = generations;
 	}
 
+	uint64_t getTargetFitness() const {
+		return targetFitness;
+	}
+
+	void setTargetFitness(uint64_t targetFitness = 0) {
+		this->targetFitness = targetFitness;
+	}
+
+	const Chromosome& getSeed() const {
+		return seed;
+	}
+
+	void setSeed(const Chromosome& seed) {
+		this->seed = seed;
+	}
+
+	unsigned getBatchTiles() const {
+		return batchTiles;
+	}
+
+	void setBatchTiles(unsigned batchTiles = 0) {
+		this->batchTiles = batchTiles;
+	}
+
+	unsigned getBatchReevaluate() const {
+		return batchReevaluate;
+	}
+
+	void setBatchReevaluate(unsigned batchReevaluate = 100) {
+		this->batchReevaluate = batchReevaluate;
+	}
+
+	unsigned getBatchWindow() const {
+		return batchWindow;
+	}
+
+	void setBatchWindow(unsigned batchWindow = 1) {
+		this->batchWindow = batchWindow;
+	}
+
+	BatchSelection getBatchSelection() const {
+		return batchSelection;
+	}
+
+	void setBatchSelection(BatchSelection batchSelection = BatchSelection::RANDOM) {
+		this->batchSelection = batchSelection;
+	}
+
+	const Samples* getTrainSamples() const {
+		return trainSamples;
+	}
+
+	/**
+	 * Sets compressed training set that is used by evolution instead of training images.
+	 * Samples must be created by compress from the same training images that are passed to evolution
+	 * and they must exist until evolution ends.
+	 *
+	 * @param[in] trainSamples
+	 * 	Compressed training set. nullptr evaluates training images.
+	 */
+	void setTrainSamples(const Samples* trainSamples = nullptr) {
+		this->trainSamples = trainSamples;
+	}
+
+	unsigned getProbeSamples() const {
+		return probeSamples;
+	}
+
+	void setProbeSamples(unsigned probeSamples = 0) {
+		this->probeSamples = probeSamples;
+	}
+
+	double getProbeTolerance() const {
+		return probeTolerance;
+	}
+
+	void setProbeTolerance(double probeTolerance = 2) {
+		this->probeTolerance = probeTolerance;
+	}
+
+	unsigned getPyramidLevels() const {
+		return pyramidLevels;
+	}
+
+	void setPyramidLevels(unsigned pyramidLevels = 1) {
+		this->pyramidLevels = pyramidLevels;
+	}
+
+	unsigned getPyramidGenerations() const {
+		return pyramidGenerations;
+	}
+
+	void setPyramidGenerations(unsigned pyramidGenerations = 1000) {
+		this->pyramidGenerations = pyramidGenerations;
+	}
+
+	unsigned getPyramidStagnation() const {
+		return pyramidStagnation;
+	}
+
+	void setPyramidStagnation(unsigned pyramidStagnation = 0) {
+		this->pyramidStagnation = pyramidStagnation;
+	}
+
+	bool getVerbose() const {
+		return verbose;
+	}
+
+	void setVerbose(bool verbose = true) {
+		this->verbose = verbose;
+	}
+
+	/**
+	 * Number of generations performed by last evolve call.
+	 * When the target fitness was reached, it is the generation in which it happened.
+	 *
+	 * @return Number of generations (summed over all runs).
+	 */
+	uint64_t getLastGenerations() const {
+		return lastGenerations;
+	}
+
 	static const unsigned PARAM_IN=9;	//! Number of inputs. (9-> 3x3 kernel)
 	static const unsigned PARAM_OUT=1;	//! Number of outpus.
 	static const unsigned CHROMOSOME_BLOCK_SIZE=3; //!number of integers representing one block in chromosome
+	static const uint64_t STREAM_BAND_BYTES=4*1024*1024; //! size of band of rows for streamed images
+	static const uint64_t TASK_PIXELS=64*1024; //! number of pixels in one task for thread pool
+	static const uint64_t DIRTY_BLOCK=16; //! size of blocks that are compared by incremental filtering
+	static const uint64_t MASK_TILE=16; //! size of tiles of mask that are skipped when nothing is masked
+	static const uint64_t UNIFORM_TILE=8; //! number of pixels that are checked for uniform neighbourhoods at once
+	static const uint64_t EVAL_TILE=32; //! size of tiles of training images that are evaluated by whole population at once
+	static const uint64_t COMPRESS_RATIO=4; //! compressed training set is used when it has at most 1/COMPRESS_RATIO of pixels
+	static const uint64_t COMPRESS_MAX_SAMPLES=1<<20; //! max number of unique samples in compressed training set (bounds its memory)
 private:
 	unsigned cols;	//! cols in CGP matrix
 	unsigned rows;	//! rows in CGP matrix
@@ -224,6 +1054,22 @@ private:
 	unsigned generations=50000; //! number of generations
 	unsigned mutationMax=3; //! maximum number of mutations for one mutation
 	unsigned lBack=1; //! CGP lBack parameter
+	uint64_t targetFitness=0; //! evolution stops when fitness is lower or equal
+	Chromosome seed; //! initial parent for each run (random population is used when empty)
+	bool verbose=true; //! prints evolution progress to stdout
+	uint64_t lastGenerations=0; //! generations performed by last evolution
+	unsigned batchTiles=0; //! number of random training tiles evaluated in each generation (0 all)
+	unsigned batchReevaluate=100; //! generations between evaluations of parent on all tiles (with batchTiles)
+	unsigned batchWindow=1; //! generations that use the same subset of tiles (with batchTiles)
+	BatchSelection batchSelection=BatchSelection::RANDOM; //! selection of subset of tiles (with batchTiles)
+	const Samples* trainSamples=nullptr; //! compressed training set used instead of training images (nullptr not used)
+	unsigned probeSamples=0; //! number of probe samples for rejection of hopeless offspring (0 no probe)
+	double probeTolerance=2; //! offspring with probe error higher than probeTolerance times error of parent are rejected
+	unsigned pyramidLevels=1; //! number of levels of image pyramid for evolution (1 full resolution only)
+	unsigned pyramidGenerations=1000; //! max generations on each coarse level of pyramid
+	unsigned pyramidStagnation=0; //! coarse level of pyramid ends after this number of generations without improvement (0 never)
+	unsigned stagnation=0; //! evolution run ends after this number of generations without improvement (0 never)
+	std::vector<double> functionCosts; //! weights of functions for execution cost
 
 
 
@@ -233,9 +1079,14 @@ private:
 
 	std::vector<std::vector<int>> colVal; //! Pre calculated posible values of inputs for columns
 
-	std::vector<uint8_t> outputs; //! tmp cache for block outputs when filter is applied.
+	std::vector<uint8_t> outputs; //! tmp cache for filter inputs and block outputs when filter is applied.
+
+	std::vector<uint8_t> resCache; //! tmp cache for filter result when fitness is calculated.
+
+	ThreadPool* pool=nullptr; //! threads for filter application (nullptr single thread)
 
 	std::set<unsigned> damaged; //! Contains indexes of damaged blocks. (first block index is PARAM_IN)
+	std::set<unsigned> excluded; //! Indexes of blocks that evolution can not connect (used by harden).
 
 
 	/**
@@ -244,6 +1095,41 @@ private:
 	void calcColVals();
 
 
+	/**
+	 * Creates random chromosome.
+	 * Damaged blocks have DAMAGED function.
+	 *
+	 * @return The chromosome.
+	 */
+	Chromosome randomChromosome();
+
+	/**
+	 * Inserts member into Pareto archive if it is not dominated.
+	 * Members dominated by the new one are removed and member with equal
+	 * objectives is replaced (because of diversity).
+	 *
+	 * @param[in|out] archive
+	 * 	The archive.
+	 * @param[in] m
+	 * 	New member.
+	 * @return True when member was inserted.
+	 */
+	static bool insertPareto(ParetoFront& archive, const ParetoMember& m);
+
+	/**
+	 * Evolves chromosome on image pyramid (see evolve).
+	 *
+	 * @param[in] runs
+	 * 	Number of evolution runs.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @return Evolved chromosome of a filter.
+	 */
+	Chromosome evolvePyramid(const unsigned runs,
+				const std::vector<Image> & train, const std::vector<Image> & trainOut);
+
 	/**
 	 * Evaluates given population.
 	 *
@@ -257,23 +1143,12 @@ private:
 	 * 	Train images that will be used as input for filter.
 	 * @param[in] trainOut
 	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 * @param[in] samples
+	 * 	Compressed training images that are used instead of images (nullptr means images are used).
 	 */
 	void evaluate(const Population& population, uint64_t& bestFitness, unsigned& bestIndex,
-			const std::vector<Image>& train, const std::vector<Image>& trainOut);
-
+			const std::vector<Image>& train, const std::vector<Image>& trainOut, const Samples* samples=nullptr);
 
-	/**
-	 * Apply filter.
-	 *
-	 * @param[in] c
-	 * 	Filter representation by chromosome.
-	 * @param[in] usedBlocks
-	 * 	Indexes of used blocks.
-	 * @param[in] input
-	 * 	Filter inputs.
-	 * @return Result of filter
-	 */
-	uint8_t apply(const Chromosome&c, const std::set<unsigned>& usedBlocks, const std::vector<uint8_t>& inputs);
 
 
 
@@ -0,0 +1,188 @@
+/**
+ * Project: EDEF
+ * @file Campaign.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for fault-injection campaign (damage x repair matrix).
+ */
+
+#include "Campaign.h"
+#include <set>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <limits>
+
+Campaign::Campaign(const Config& config, const Chromosome& c,
+		const std::vector<Image>& train, const std::vector<Image>& trainOut):
+		config(config), original(c), train(train), trainOut(trainOut){
+
+	CGP cgp(config.getCols(), config.getRows());
+	originalFitness=cgp.fitness(original, train, trainOut);
+
+	//train set is compressed only once for all repairs
+	compressed=CGP::compress(train, trainOut, samples);
+}
+
+uint64_t Campaign::generatePatterns(unsigned k, uint64_t samples){
+	patterns.clear();
+
+	//only blocks that are not damaged yet can be damaged
+	std::vector<unsigned> blocks;
+	std::set<unsigned> damagedBlocks(CGP::damagedBlocks(original));
+	for(unsigned idx=CGP::PARAM_IN; idx<CGP::PARAM_IN+config.getCols()*config.getRows(); ++idx){
+		if(damagedBlocks.find(idx)==damagedBlocks.end()){
+			blocks.push_back(idx);
+		}
+	}
+
+	if(k==0 || k>blocks.size()) return 0;
+
+	//number of combinations (saturated)
+	uint64_t combinations=1;
+	for(unsigned i=0; i<k; ++i){
+		uint64_t n=blocks.size()-i;
+		if(combinations>std::numeric_limits<uint64_t>::max()/n){
+			combinations=std::numeric_limits<uint64_t>::max();
+			break;
+		}
+		combinations=combinations*n/(i+1);
+	}
+
+	if(samples==0 || combinations<=samples){
+		//enumerate all of them
+		std::vector<unsigned> sel(k);
+		for(unsigned i=0; i<k; ++i) sel[i]=i;
+
+		while(true){
+			std::vector<unsigned> pattern(k);
+			for(unsigned i=0; i<k; ++i) pattern[i]=blocks[sel[i]];
+			patterns.push_back(pattern);
+
+			//next combination
+			int i=k-1;
+			while(i>=0 && sel[i]==blocks.size()-k+i) --i;
+			if(i<0) break;
+			++sel[i];
+			for(unsigned j=i+1; j<k; ++j) sel[j]=sel[j-1]+1;
+		}
+	}else{
+		//random sample of distinct patterns
+		std::mt19937 randGen;
+		randGen.seed(std::random_device()());
+		std::set<std::vector<unsigned>> selected;
+		while(selected.size()<samples){
+			std::vector<unsigned> shuffled(blocks);
+			for(unsigned i=0; i<k; ++i){
+				std::uniform_int_distribution<std::mt19937::result_type> dist(i, shuffled.size()-1);
+				std::swap(shuffled[i], shuffled[dist(randGen)]);
+			}
+			std::vector<unsigned> pattern(shuffled.begin(), shuffled.begin()+k);
+			std::sort(pattern.begin(), pattern.end());
+			if(selected.insert(pattern).second){
+				patterns.push_back(pattern);
+			}
+		}
+	}
+
+	return patterns.size();
+}
+
+Campaign::Result Campaign::repair(CGP& cgp, uint64_t pattern){
+	Result res;
+	res.pattern=pattern;
+	res.blocks=patterns[pattern];
+
+	Chromosome c(original);
+	std::set<unsigned> usedB(CGP::usedBlocks(original));
+	res.usedDamaged=0;
+	for(auto b : res.blocks){
+		CGP::damageBlock(c, b);
+		if(usedB.find(b)!=usedB.end()) ++res.usedDamaged;
+	}
+
+	res.fitnessBefore=cgp.fitness(c, train, trainOut);
+	if(res.fitnessBefore<=originalFitness){
+		//nothing to repair
+		res.fitnessAfter=res.fitnessBefore;
+		res.generations=0;
+		res.recovered=true;
+		return res;
+	}
+
+	//repair continues from the damaged filter and stops when it is as good as the original
+	cgp.setDamaged(CGP::damagedBlocks(c));
+	cgp.setSeed(c);
+	cgp.setTargetFitness(originalFitness);
+
+	Chromosome repC=cgp.evolve(config.getRuns(), train, trainOut);
+	res.fitnessAfter=cgp.fitness(repC, train, trainOut);
+	res.generations=cgp.getLastGenerations();
+	res.recovered=res.fitnessAfter<=originalFitness;
+
+	return res;
+}
+
+void Campaign::run(unsigned threads, std::ostream& csv){
+	if(threads==0) threads=1;
+
+	csv << "pattern,damaged_blocks,used_damaged,fitness_original,fitness_before,fitness_after,generations_to_recover,recovered" << std::endl;
+
+	std::atomic<uint64_t> next(0);
+	std::mutex outMutex;
+	uint64_t done=0;
+
+	std::exception_ptr error;	//first error of a worker
+
+	auto worker=[&](){
+		try{
+			CGP cgp(config.getCols(), config.getRows(), config.getlBack());
+			cgp.setPopulationSize(config.getPopulationSize());
+			cgp.setMutationMax(config.getMaxMutations());
+			cgp.setGenerations(config.getGenerations());
+			cgp.setVerbose(false);
+			cgp.setTrainSamples(compressed ? &samples : nullptr);
+
+			for(uint64_t p=next++; p<patterns.size(); p=next++){
+				Result res=repair(cgp, p);
+
+				std::lock_guard<std::mutex> lock(outMutex);
+				csv << res.pattern << ",";
+				for(unsigned i=0; i<res.blocks.size(); ++i){
+					if(i>0) csv << " ";
+					csv << res.blocks[i];
+				}
+				csv << "," << res.usedDamaged << "," << originalFitness << "," << res.fitnessBefore
+						<< "," << res.fitnessAfter << ",";
+				if(res.recovered){
+					csv << res.generations;
+				}else{
+					csv << -1;
+				}
+				csv << "," << res.recovered << std::endl;
+
+				std::cout << "\tRepaired " << ++done << "/" << patterns.size() << std::endl;
+			}
+		}catch(...){
+			//other workers stop too
+			std::lock_guard<std::mutex> lock(outMutex);
+			if(!error) error=std::current_exception();
+			next=patterns.size();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned t=1; t<threads; ++t){
+		workers.emplace_back(worker);
+	}
+	worker();
+	for(auto& w : workers){
+		w.join();
+	}
+	if(error) std::rethrow_exception(error);
+}
+
+/*** End of file: Campaign.cpp ***/
@@ -0,0 +1,110 @@
+/**
+ * Project: EDEF
+ * @file Campaign.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for fault-injection campaign (damage x repair matrix).
+ */
+
+#ifndef SRC_CAMPAIGN_H_
+#define SRC_CAMPAIGN_H_
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include "CGP.h"
+#include "Config.h"
+#include "Image.h"
+
+/**
+ * Damages given filter with many damage patterns of k blocks and repairs each of them.
+ * Training set is loaded only once and patterns are repaired in parallel.
+ */
+class Campaign {
+public:
+
+	/**
+	 * Result of one damage pattern repair.
+	 */
+	struct Result {
+		uint64_t pattern;	//! Index of damage pattern.
+		std::vector<unsigned> blocks;	//! Damaged blocks.
+		unsigned usedDamaged;	//! Number of damaged blocks that were used by the filter.
+		uint64_t fitnessBefore;	//! Fitness of damaged filter.
+		uint64_t fitnessAfter;	//! Fitness of repaired filter.
+		uint64_t generations;	//! Generations needed for repair.
+		bool recovered;	//! True when repaired filter is at least as good as the original one.
+	};
+
+	/**
+	 * Creates campaign.
+	 *
+	 * @param[in] config
+	 * 	Evolution configuration (COLS and ROWS must be the chromosome ones).
+	 * @param[in] c
+	 * 	The filter that will be damaged.
+	 * @param[in] train
+	 * 	Train images that will be used as input for filter.
+	 * @param[in] trainOut
+	 * 	Train images that will be used for filter evaluation. (Desired result)
+	 */
+	Campaign(const Config& config, const Chromosome& c,
+			const std::vector<Image>& train, const std::vector<Image>& trainOut);
+
+	/**
+	 * Generates damage patterns.
+	 * All combinations of k not yet damaged blocks are used when there is
+	 * at most samples of them, otherwise samples random patterns are selected.
+	 *
+	 * @param[in] k
+	 * 	Number of damaged blocks in pattern.
+	 * @param[in] samples
+	 * 	Maximal number of patterns. (0 means all)
+	 * @return Number of generated patterns.
+	 */
+	uint64_t generatePatterns(unsigned k, uint64_t samples);
+
+	/**
+	 * Repairs all patterns and writes results in CSV format.
+	 * Rows are written as soon as repair is finished so their order may differ from pattern order.
+	 *
+	 * @param[in] threads
+	 * 	Number of working threads.
+	 * @param[out] csv
+	 * 	Stream for results.
+	 */
+	void run(unsigned threads, std::ostream& csv);
+
+	uint64_t getOriginalFitness() const {
+		return originalFitness;
+	}
+
+	const std::vector<std::vector<unsigned>>& getPatterns() const {
+		return patterns;
+	}
+
+private:
+	const Config& config;	//! evolution configuration
+	const Chromosome& original;	//! the undamaged filter
+	const std::vector<Image>& train;	//! train set
+	const std::vector<Image>& trainOut;	//! train set desired output
+	uint64_t originalFitness;	//! fitness of the undamaged filter
+	CGP::Samples samples;	//! compressed train set shared by all repairs (empty when compression does not pay off)
+	bool compressed;	//! true when samples are used
+	std::vector<std::vector<unsigned>> patterns;	//! damage patterns
+
+	/**
+	 * Repairs one pattern.
+	 *
+	 * @param[in] cgp
+	 * 	CGP used for repair. (Each thread has its own.)
+	 * @param[in] pattern
+	 * 	Index of pattern.
+	 * @return Repair result.
+	 */
+	Result repair(CGP& cgp, uint64_t pattern);
+};
+
+#endif /* SRC_CAMPAIGN_H_ */
+
+/*** End of file: Campaign.h ***/
@@ -65,6 +65,50 @@ void Config::read(std::istream& input){
 	sConv << data["RUNS"];
 	sConv >> runs;
 	sConv.clear();
+
+	readOptional("CAMPAIGN_DAMAGE", campaignDamage);
+	readOptional("CAMPAIGN_SAMPLES", campaignSamples);
+	readOptional("HARDEN_ALTERNATIVES", hardenAlternatives);
+	readOptional("HARDEN_TOLERANCE", hardenTolerance);
+	readOptional("SHRINK_GENERATIONS", shrinkGenerations);
+	readOptional("BATCH_TILES", batchTiles);
+	readOptional("BATCH_REEVALUATE", batchReevaluate);
+	readOptional("BATCH_WINDOW", batchWindow);
+	readOptional("BATCH_SELECTION", batchSelection);
+	readOptional("PROBE_SAMPLES", probeSamples);
+	readOptional("PROBE_TOLERANCE", probeTolerance);
+	readOptional("PYRAMID_LEVELS", pyramidLevels);
+	readOptional("PYRAMID_GENERATIONS", pyramidGenerations);
+	readOptional("PYRAMID_STAGNATION", pyramidStagnation);
+
+	functionCosts.clear();
+	auto costs=data.find("FUNCTION_COSTS");
+	if(costs!=data.end()){
+		//comma separated list of weights
+		std::stringstream sCosts(costs->second);
+		std::string w;
+		while(std::getline(sCosts, w, ',')){
+			std::stringstream sW(w);
+			double val;
+			if(!(sW >> val)){
+				throw std::runtime_error("Invalid configuration file.\n\tInvalid value for key: FUNCTION_COSTS");
+			}
+			functionCosts.push_back(val);
+		}
+	}
+}
+
+template <typename T>
+void Config::readOptional(const std::string& key, T& value){
+	auto it=data.find(key);
+	if(it==data.end()) return;
+
+	std::stringstream sConv(it->second);
+	if(!(sConv >> value)){
+		std::string msg("Invalid configuration file.\n\tInvalid value for key: ");
+		msg+=key;
+		throw std::runtime_error(msg);
+	}
 }
 
 
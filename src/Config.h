@@ -10,7 +10,9 @@
 #define SRC_CONFIG_H_
 
 #include <map>
+#include <vector>
 #include <iostream>
+#include <string>
 
 /**
  * Loads and stores configuration from config file.
@@ -194,6 +196,126 @@ public:
 		this->runs = runs;
 	}
 
+	unsigned getCampaignDamage() const {
+		return campaignDamage;
+	}
+
+	void setCampaignDamage(unsigned campaignDamage) {
+		this->campaignDamage = campaignDamage;
+	}
+
+	uint64_t getCampaignSamples() const {
+		return campaignSamples;
+	}
+
+	void setCampaignSamples(uint64_t campaignSamples) {
+		this->campaignSamples = campaignSamples;
+	}
+
+	unsigned getHardenAlternatives() const {
+		return hardenAlternatives;
+	}
+
+	void setHardenAlternatives(unsigned hardenAlternatives) {
+		this->hardenAlternatives = hardenAlternatives;
+	}
+
+	double getHardenTolerance() const {
+		return hardenTolerance;
+	}
+
+	void setHardenTolerance(double hardenTolerance) {
+		this->hardenTolerance = hardenTolerance;
+	}
+
+	unsigned getShrinkGenerations() const {
+		return shrinkGenerations;
+	}
+
+	void setShrinkGenerations(unsigned shrinkGenerations) {
+		this->shrinkGenerations = shrinkGenerations;
+	}
+
+	unsigned getBatchTiles() const {
+		return batchTiles;
+	}
+
+	void setBatchTiles(unsigned batchTiles) {
+		this->batchTiles = batchTiles;
+	}
+
+	unsigned getBatchReevaluate() const {
+		return batchReevaluate;
+	}
+
+	void setBatchReevaluate(unsigned batchReevaluate) {
+		this->batchReevaluate = batchReevaluate;
+	}
+
+	unsigned getBatchWindow() const {
+		return batchWindow;
+	}
+
+	void setBatchWindow(unsigned batchWindow) {
+		this->batchWindow = batchWindow;
+	}
+
+	const std::string& getBatchSelection() const {
+		return batchSelection;
+	}
+
+	void setBatchSelection(const std::string& batchSelection) {
+		this->batchSelection = batchSelection;
+	}
+
+	unsigned getProbeSamples() const {
+		return probeSamples;
+	}
+
+	void setProbeSamples(unsigned probeSamples) {
+		this->probeSamples = probeSamples;
+	}
+
+	double getProbeTolerance() const {
+		return probeTolerance;
+	}
+
+	void setProbeTolerance(double probeTolerance) {
+		this->probeTolerance = probeTolerance;
+	}
+
+	unsigned getPyramidLevels() const {
+		return pyramidLevels;
+	}
+
+	void setPyramidLevels(unsigned pyramidLevels) {
+		this->pyramidLevels = pyramidLevels;
+	}
+
+	unsigned getPyramidGenerations() const {
+		return pyramidGenerations;
+	}
+
+	void setPyramidGenerations(unsigned pyramidGenerations) {
+		this->pyramidGenerations = pyramidGenerations;
+	}
+
+	unsigned getPyramidStagnation() const {
+		return pyramidStagnation;
+	}
+
+	void setPyramidStagnation(unsigned pyramidStagnation) {
+		this->pyramidStagnation = pyramidStagnation;
+	}
+
+	const std::vector<double>& getFunctionCosts() const {
+		return functionCosts;
+	}
+
+	void setFunctionCosts(const std::vector<double>& functionCosts) {
+		this->functionCosts = functionCosts;
+	}
+
 private:
 	std::map<std::string, std::string> data; //! Loaded configuration
 
@@ -204,6 +326,33 @@ private:
 	unsigned maxMutations;
 	unsigned generations;
 	unsigned runs;
+
+	//optional keys
+	unsigned campaignDamage=1;	//! number of damaged blocks in one campaign pattern
+	uint64_t campaignSamples=0;	//! max number of campaign patterns (0 all)
+	unsigned hardenAlternatives=3;	//! max number of alternatives in archive
+	double hardenTolerance=0;	//! relative fitness degradation allowed for alternatives
+	unsigned shrinkGenerations=0;	//! stagnation limit of shrinking after evolution (0 no shrinking)
+	unsigned batchTiles=0;	//! number of random training tiles evaluated in each generation (0 all)
+	unsigned batchReevaluate=100;	//! generations between evaluations of parent on all tiles
+	unsigned batchWindow=1;	//! generations that use the same subset of tiles
+	std::string batchSelection="random";	//! selection of subset of tiles (random or dss)
+	unsigned probeSamples=0;	//! number of probe samples for rejection of hopeless offspring (0 no probe)
+	double probeTolerance=2;	//! relative probe error of offspring (to parent) that is rejected
+	unsigned pyramidLevels=1;	//! number of levels of image pyramid for evolution (1 no pyramid)
+	unsigned pyramidGenerations=1000;	//! max generations on each coarse level of pyramid
+	unsigned pyramidStagnation=0;	//! generations without improvement that end coarse level (0 never)
+	std::vector<double> functionCosts;	//! weights of block functions for execution cost (empty default)
+
+	/**
+	 * Reads value of optional key if it is present.
+	 *
+	 * @param[in] key	The key.
+	 * @param[out] value	Read value. Stays untouched when key is missing.
+	 * @throw std::runtime_error when value is invalid
+	 */
+	template <typename T>
+	void readOptional(const std::string& key, T& value);
 };
 
 #endif /* SRC_CONFIG_H_ */
@@ -0,0 +1,129 @@
+/**
+ * Project: EDEF
+ * @file FrameStream.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for reading and writing of video frames (y4m or raw grayscale) from/to streams.
+ */
+
+#include "FrameStream.h"
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+
+const char FrameStream::Y4M_MAGIC[]="YUV4MPEG2";
+const char FrameStream::Y4M_FRAME[]="FRAME";
+
+FrameStream::FrameStream(std::FILE* in, std::FILE* out, uint64_t w, uint64_t h):
+		in(in), out(out), width(w), height(h), y4m(w==0 || h==0){
+
+	std::string header;
+	if(y4m){
+		if(!readLine(header)) throw std::runtime_error("Empty input stream.");
+		parseHeader(header);
+		header+="\n";
+		if(std::fwrite(header.data(), 1, header.size(), out)!=header.size()){
+			throw std::runtime_error("Could not write to output stream.");
+		}
+
+		//output frame is: frame header, luma, chroma
+		outputLuma=std::strlen(Y4M_FRAME)+1;
+		output.assign(outputLuma+width*height+chroma, 128);	//neutral chroma
+		std::memcpy(&output[0], Y4M_FRAME, outputLuma-1);
+		output[outputLuma-1]='\n';
+		skipped.resize(chroma);
+	}else{
+		output.resize(width*height);
+	}
+
+	input.resize(width*height);
+	previous.resize(width*height);
+}
+
+bool FrameStream::readLine(std::string& line){
+	line.clear();
+	for(int ch=std::fgetc(in); ch!='\n'; ch=std::fgetc(in)){
+		if(ch==EOF){
+			if(line.empty()) return false;
+			break;
+		}
+		line.push_back(static_cast<char>(ch));
+		if(line.size()>4096) throw std::runtime_error("Input is not valid y4m stream (use -size for raw frames).");
+	}
+	return true;
+}
+
+void FrameStream::parseHeader(const std::string& header){
+	std::istringstream tokens(header);
+	std::string token;
+	if(!(tokens >> token) || token!=Y4M_MAGIC){
+		throw std::runtime_error("Input is not y4m stream (use -size for raw frames).");
+	}
+
+	std::string colorspace("420");
+	while(tokens >> token){
+		std::istringstream value(token.substr(1));
+		switch(token[0]){
+			case 'W':
+				value >> width;
+				break;
+			case 'H':
+				value >> height;
+				break;
+			case 'C':
+				colorspace=token.substr(1);
+				break;
+			default:
+				//frame rate, interlacing, aspect ratio and extensions are just copied
+				break;
+		}
+	}
+
+	if(width==0 || height==0) throw std::runtime_error("Invalid y4m header (missing dimensions).");
+
+	uint64_t halfW=(width+1)/2;
+	if(colorspace=="mono"){
+		chroma=0;
+	}else if(colorspace=="420" || colorspace=="420jpeg" || colorspace=="420mpeg2" || colorspace=="420paldv"){
+		chroma=2*halfW*((height+1)/2);
+	}else if(colorspace=="422"){
+		chroma=2*halfW*height;
+	}else if(colorspace=="411"){
+		chroma=2*((width+3)/4)*height;
+	}else if(colorspace=="444"){
+		chroma=2*width*height;
+	}else if(colorspace=="444alpha"){
+		chroma=3*width*height;
+	}else{
+		throw std::runtime_error("Unsupported y4m colorspace (only 8 bit formats are supported): "+colorspace);
+	}
+}
+
+bool FrameStream::readFrame(){
+	if(y4m){
+		std::string header;
+		if(!readLine(header)) return false;
+		if(header.compare(0, std::strlen(Y4M_FRAME), Y4M_FRAME)!=0){
+			throw std::runtime_error("Invalid y4m stream (missing frame header).");
+		}
+	}
+
+	//last frame becomes previous one, so it does not need to be copied
+	input.swap(previous);
+	uint64_t n=std::fread(&input[0], 1, input.size(), in);
+	if(n==0 && !y4m) return false;
+	if(n!=input.size() || (chroma>0 && std::fread(&skipped[0], 1, chroma, in)!=chroma)){
+		throw std::runtime_error("Truncated frame.");
+	}
+	++frames;
+	return true;
+}
+
+void FrameStream::writeFrame(){
+	//flush per frame, so the frame leaves as soon as it is done
+	if(std::fwrite(&output[0], 1, output.size(), out)!=output.size() || std::fflush(out)!=0){
+		throw std::runtime_error("Could not write to output stream.");
+	}
+}
+
+/*** End of file: FrameStream.cpp ***/
@@ -0,0 +1,144 @@
+/**
+ * Project: EDEF
+ * @file FrameStream.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for reading and writing of video frames (y4m or raw grayscale) from/to streams.
+ */
+
+#ifndef SRC_FRAMESTREAM_H_
+#define SRC_FRAMESTREAM_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Reads frames from input stream and writes filtered frames to output stream.
+ * Supports YUV4MPEG2 (y4m) video, where luma plane is filtered and chroma planes are set to neutral
+ * gray, and raw grayscale frames of fixed size (one byte per pixel, no headers).
+ * Frames are read and written directly from/to frame buffers, so there is no copying per frame.
+ */
+class FrameStream {
+public:
+	/**
+	 * Creates stream.
+	 * When size is not given, input must be y4m and the y4m header is read and copied to output.
+	 *
+	 * @param[in] in
+	 * 	Input stream.
+	 * @param[in] out
+	 * 	Output stream.
+	 * @param[in] w
+	 * 	Width of raw frames. 0 for y4m.
+	 * @param[in] h
+	 * 	Height of raw frames. 0 for y4m.
+	 * @throw std::runtime_error	When y4m header is invalid or format is not supported.
+	 */
+	FrameStream(std::FILE* in, std::FILE* out, uint64_t w=0, uint64_t h=0);
+
+	/**
+	 * Reads next frame to input buffer.
+	 *
+	 * @return False when there are no more frames.
+	 * @throw std::runtime_error	When frame is truncated or invalid.
+	 */
+	bool readFrame();
+
+	/**
+	 * Writes output buffer as next frame.
+	 *
+	 * @throw std::runtime_error	When frame could not be written.
+	 */
+	void writeFrame();
+
+	/**
+	 * Grayscale (luma) pixels of last read frame.
+	 *
+	 * @return Pixels (width*height).
+	 */
+	const uint8_t* getInput() const {
+		return &input[0];
+	}
+
+	/**
+	 * Grayscale (luma) pixels of frame read before the last one.
+	 *
+	 * @return Pixels (width*height). Valid only when hasPrevious() is true.
+	 */
+	const uint8_t* getPrevious() const {
+		return &previous[0];
+	}
+
+	/**
+	 * Checks if there is frame before the last read one.
+	 *
+	 * @return True when at least two frames were read.
+	 */
+	bool hasPrevious() const {
+		return frames>1;
+	}
+
+	/**
+	 * Buffer for grayscale (luma) pixels of next written frame.
+	 * Keeps content of previous written frame.
+	 *
+	 * @return Pixels (width*height).
+	 */
+	uint8_t* getOutput() {
+		return &output[outputLuma];
+	}
+
+	uint64_t getWidth() const {
+		return width;
+	}
+
+	uint64_t getHeight() const {
+		return height;
+	}
+
+	bool isY4M() const {
+		return y4m;
+	}
+
+private:
+	static const char Y4M_MAGIC[];	//! start of y4m header
+	static const char Y4M_FRAME[];	//! start of y4m frame header
+
+	std::FILE* in;	//! input stream
+	std::FILE* out;	//! output stream
+	uint64_t width;
+	uint64_t height;
+	bool y4m;	//! y4m or raw frames
+	uint64_t chroma=0;	//! size of chroma (and alpha) planes of one y4m frame
+	std::vector<uint8_t> input;	//! luma of input frame
+	std::vector<uint8_t> previous;	//! luma of previous input frame
+	uint64_t frames=0;	//! number of read frames
+	std::vector<uint8_t> skipped;	//! chroma of input frame (not used)
+	std::vector<uint8_t> output;	//! whole output frame (with header)
+	uint64_t outputLuma=0;	//! offset of luma in output frame
+
+	/**
+	 * Reads one header line (without the newline).
+	 *
+	 * @param[out] line
+	 * 	The line.
+	 * @return False on end of stream before any character.
+	 * @throw std::runtime_error	When line is too long.
+	 */
+	bool readLine(std::string& line);
+
+	/**
+	 * Parses y4m stream header and sets dimensions and chroma size.
+	 *
+	 * @param[in] header
+	 * 	Header line.
+	 * @throw std::runtime_error	When header is invalid or format is not supported.
+	 */
+	void parseHeader(const std::string& header);
+};
+
+#endif /* SRC_FRAMESTREAM_H_ */
+
+/*** End of file: FrameStream.h ***/
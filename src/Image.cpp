@@ -9,6 +9,7 @@
 /*** End of file: Image.cpp ***/
 #include "Image.h"
 #include <stdexcept>
+#include <limits>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -51,6 +52,58 @@ void Image::load(const std::string& path){
 	stbi_image_free(tmpPixels);
 }
 
+void Image::decode(const uint8_t* data, uint64_t size){
+	free();
+	if(size>static_cast<uint64_t>(std::numeric_limits<int>::max())) throw std::runtime_error("Invalid image: too big");
+
+	int channels;
+	uint8_t* tmpPixels=stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 1);
+	if(tmpPixels == NULL) throw std::runtime_error("Invalid image.");
+
+	bytesPerPixel=1;
+	pixels.insert(pixels.end(), &tmpPixels[0], &tmpPixels[width*height]);
+	stbi_image_free(tmpPixels);
+}
+
+/**
+ * Appends encoded data to vector.
+ *
+ * @param[in] context
+ * 	The vector.
+ * @param[in] data
+ * 	Encoded data.
+ * @param[in] size
+ * 	Size of data.
+ */
+static void appendEncoded(void* context, void* data, int size){
+	std::vector<uint8_t>* res=static_cast<std::vector<uint8_t>*>(context);
+	res->insert(res->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data)+size);
+}
+
+std::vector<uint8_t> Image::encode() const{
+	std::vector<uint8_t> res;
+	if(stbi_write_jpg_to_func(appendEncoded, &res, width, height, bytesPerPixel, &pixels[0], 100)==0){
+		throw std::runtime_error("Could not encode image.");
+	}
+	return res;
+}
+
+Image Image::downscale() const{
+	if(pixels.empty()) return Image();
+	const unsigned w=(width+1)/2;
+	const unsigned h=(height+1)/2;
+	std::vector<uint8_t> res(static_cast<uint64_t>(w)*h);
+	for(unsigned y=0; y<h; ++y){
+		const uint8_t* row=&pixels[static_cast<uint64_t>(2*y)*width];
+		const uint8_t* below= 2*y+1<static_cast<unsigned>(height) ? row+width : row;
+		for(unsigned x=0; x<w; ++x){
+			unsigned next= 2*x+1<static_cast<unsigned>(width) ? 2*x+1 : 2*x;
+			res[static_cast<uint64_t>(y)*w+x]=(row[2*x]+row[next]+below[2*x]+below[next]+2)/4;
+		}
+	}
+	return Image(w, h, res);
+}
+
 void Image::free(){
 	pixels.clear();
 }
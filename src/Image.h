@@ -64,6 +64,35 @@ public:
 	 */
 	void save(const std::string& path);
 
+	/**
+	 * Loads image from encoded data in memory (jpg, png, ...).
+	 * Image is converted to grayscale.
+	 * Old is forgotten.
+	 *
+	 * @param[in] data
+	 * 	Encoded image.
+	 * @param[in] size
+	 * 	Size of encoded image in bytes.
+	 * @throw std::runtime_error	When image is invalid.
+	 */
+	void decode(const uint8_t* data, uint64_t size);
+
+	/**
+	 * Encodes image as jpg into memory.
+	 *
+	 * @return Encoded image.
+	 * @throw std::runtime_error	When image could not be encoded.
+	 */
+	std::vector<uint8_t> encode() const;
+
+	/**
+	 * Creates image with half width and height.
+	 * Each pixel is rounded average of 2x2 pixels (last odd row or column is repeated).
+	 *
+	 * @return Downscaled image.
+	 */
+	Image downscale() const;
+
 	/**
 	 * Fills image with data.
 	 * Only one byte pet pixel
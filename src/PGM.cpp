@@ -0,0 +1,83 @@
+/**
+ * Project: EDEF
+ * @file PGM.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for row by row reading and writing of binary PGM (P5) images.
+ */
+
+#include "PGM.h"
+#include <stdexcept>
+#include <cctype>
+
+PGMReader::PGMReader(const std::string& path): f(path, std::ios::binary), path(path){
+	std::string msg("Invalid image: ");
+	msg+=path;
+
+	char magic[2];
+	if(!f.read(magic, 2) || magic[0]!='P' || magic[1]!='5') throw std::runtime_error(msg);
+
+	width=readHeaderNumber();
+	height=readHeaderNumber();
+	maxVal=readHeaderNumber();
+	if(maxVal==0 || maxVal>255) throw std::runtime_error(msg+" (only 8 bit images are supported)");
+
+	//single whitespace separates header from data
+	f.get();
+	if(!f) throw std::runtime_error(msg);
+}
+
+uint64_t PGMReader::readHeaderNumber(){
+	int ch=f.get();
+	while(f && (std::isspace(ch) || ch=='#')){
+		if(ch=='#'){
+			//comment till the end of line
+			while(f && ch!='\n') ch=f.get();
+		}
+		ch=f.get();
+	}
+
+	if(!f || !std::isdigit(ch)){
+		throw std::runtime_error("Invalid image header: "+path);
+	}
+
+	uint64_t res=0;
+	while(f && std::isdigit(ch)){
+		res=res*10+(ch-'0');
+		ch=f.get();
+	}
+	f.unget();
+	return res;
+}
+
+uint64_t PGMReader::readRows(uint8_t* dst, uint64_t n){
+	if(n>height-rowsRead) n=height-rowsRead;
+	if(n==0) return 0;
+
+	if(!f.read(reinterpret_cast<char*>(dst), n*width)){
+		throw std::runtime_error("Truncated image: "+path);
+	}
+	if(maxVal!=255){
+		//filters work with full range
+		for(uint8_t* px=dst; px<dst+n*width; ++px){
+			if(*px>maxVal) throw std::runtime_error("Pixel above maxval in image: "+path);
+			*px=static_cast<uint8_t>((*px*255+maxVal/2)/maxVal);
+		}
+	}
+	rowsRead+=n;
+	return n;
+}
+
+PGMWriter::PGMWriter(const std::string& path, uint64_t w, uint64_t h):
+		f(path, std::ios::binary), path(path), width(w), height(h){
+	if(!f) throw std::runtime_error("Could not save image: "+path);
+	f << "P5\n" << width << " " << height << "\n255\n";
+}
+
+void PGMWriter::writeRows(const uint8_t* src, uint64_t n){
+	if(!f.write(reinterpret_cast<const char*>(src), n*width)){
+		throw std::runtime_error("Could not save image: "+path);
+	}
+}
+
+/*** End of file: PGM.cpp ***/
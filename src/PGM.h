@@ -0,0 +1,114 @@
+/**
+ * Project: EDEF
+ * @file PGM.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for row by row reading and writing of binary PGM (P5) images.
+ */
+
+#ifndef SRC_PGM_H_
+#define SRC_PGM_H_
+
+#include <stdint.h>
+#include <string>
+#include <fstream>
+
+/**
+ * Reads binary grayscale PGM (P5) image row by row.
+ * Only one byte per pixel images are supported. Pixels of images with maxval lower
+ * than 255 are rescaled to 0..255.
+ */
+class PGMReader {
+public:
+	/**
+	 * Opens image and reads its header.
+	 *
+	 * @param[in] path	to file containing pgm image.
+	 * @throw std::runtime_error	When image is invalid.
+	 */
+	PGMReader(const std::string& path);
+
+	/**
+	 * Reads next rows of the image.
+	 *
+	 * @param[out] dst
+	 * 	Buffer for n*width pixels.
+	 * @param[in] n
+	 * 	Number of rows.
+	 * @return Number of rows that were read. (Lower than n at the end of image.)
+	 * @throw std::runtime_error	When image data are truncated or pixel is above maxval.
+	 */
+	uint64_t readRows(uint8_t* dst, uint64_t n);
+
+	uint64_t getWidth() const {
+		return width;
+	}
+
+	uint64_t getHeight() const {
+		return height;
+	}
+
+private:
+	std::ifstream f;	//! the image file
+	std::string path;	//! path to the image
+	uint64_t width=0;
+	uint64_t height=0;
+	uint64_t maxVal=255;	//! maximal value of pixel in file
+	uint64_t rowsRead=0;	//! number of already read rows
+
+	/**
+	 * Reads one number from header. Skips whitespaces and comments.
+	 *
+	 * @return The number.
+	 * @throw std::runtime_error	When header is invalid.
+	 */
+	uint64_t readHeaderNumber();
+};
+
+/**
+ * Writes binary grayscale PGM (P5) image row by row.
+ */
+class PGMWriter {
+public:
+	/**
+	 * Creates image file and writes its header.
+	 *
+	 * @param[in] path
+	 * 	Path to file.
+	 * @param[in] w
+	 * 	Width
+	 * @param[in] h
+	 * 	Height
+	 * @throw std::runtime_error	When file could not be created.
+	 */
+	PGMWriter(const std::string& path, uint64_t w, uint64_t h);
+
+	/**
+	 * Writes next rows of the image.
+	 *
+	 * @param[in] src
+	 * 	Pixels of n rows.
+	 * @param[in] n
+	 * 	Number of rows.
+	 * @throw std::runtime_error	When rows could not be written.
+	 */
+	void writeRows(const uint8_t* src, uint64_t n);
+
+	uint64_t getWidth() const {
+		return width;
+	}
+
+	uint64_t getHeight() const {
+		return height;
+	}
+
+private:
+	std::ofstream f;	//! the image file
+	std::string path;	//! path to the image
+	uint64_t width=0;
+	uint64_t height=0;
+};
+
+#endif /* SRC_PGM_H_ */
+
+/*** End of file: PGM.h ***/
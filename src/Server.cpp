@@ -0,0 +1,421 @@
+/**
+ * Project: EDEF
+ * @file Server.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for filter daemon on Unix domain socket and its client.
+ */
+
+#include "Server.h"
+#include "Image.h"
+#include <stdexcept>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * Pipe that wakes up accepting loop when the server should stop.
+ */
+static int stopPipe[2]={-1, -1};
+
+/**
+ * Signal handler that stops the server.
+ *
+ * @param[in] sig
+ * 	The signal.
+ */
+static void stopServer(int sig){
+	(void)sig;
+	char c=0;
+	if(write(stopPipe[1], &c, 1)<0){
+		//nothing we can do in signal handler
+	}
+}
+
+/**
+ * Reads exactly n bytes from socket.
+ *
+ * @param[in] fd
+ * 	The socket.
+ * @param[out] dst
+ * 	Buffer for data.
+ * @param[in] n
+ * 	Number of bytes.
+ * @return False when connection was closed or failed.
+ */
+static bool readAll(int fd, void* dst, uint64_t n){
+	uint8_t* d=static_cast<uint8_t*>(dst);
+	while(n>0){
+		ssize_t r=recv(fd, d, n, 0);
+		if(r<0 && errno==EINTR) continue;
+		if(r<=0) return false;
+		d+=r;
+		n-=r;
+	}
+	return true;
+}
+
+/**
+ * Writes exactly n bytes to socket.
+ *
+ * @param[in] fd
+ * 	The socket.
+ * @param[in] src
+ * 	Data.
+ * @param[in] n
+ * 	Number of bytes.
+ * @return False when connection was closed or failed.
+ */
+static bool writeAll(int fd, const void* src, uint64_t n){
+	const uint8_t* s=static_cast<const uint8_t*>(src);
+	while(n>0){
+		ssize_t w=send(fd, s, n, MSG_NOSIGNAL);
+		if(w<0 && errno==EINTR) continue;
+		if(w<=0) return false;
+		s+=w;
+		n-=w;
+	}
+	return true;
+}
+
+/**
+ * Creates address of Unix domain socket.
+ *
+ * @param[in] path
+ * 	Path to socket.
+ * @return The address.
+ * @throw std::runtime_error	When path is too long.
+ */
+static sockaddr_un socketAddress(const std::string& path){
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	if(path.empty() || path.size()>=sizeof(addr.sun_path)){
+		throw std::runtime_error("Invalid path to socket: "+path);
+	}
+	std::memcpy(addr.sun_path, path.c_str(), path.size());
+	return addr;
+}
+
+Server::Server(const std::string& path, unsigned threads): path(path), pool(threads), requests(0){
+	sockaddr_un addr=socketAddress(path);
+
+	//remove socket that was left by previous run
+	struct stat st;
+	if(stat(path.c_str(), &st)==0 && S_ISSOCK(st.st_mode)) unlink(path.c_str());
+
+	listenFd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenFd<0) throw std::runtime_error("Could not create socket.");
+	if(bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))<0 || listen(listenFd, SOMAXCONN)<0){
+		close(listenFd);
+		throw std::runtime_error("Could not listen on socket: "+path);
+	}
+}
+
+Server::~Server(){
+	close(listenFd);
+	unlink(path.c_str());
+}
+
+void Server::run(){
+	if(pipe(stopPipe)<0) throw std::runtime_error("Could not create pipe.");
+
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler=stopServer;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	pollfd fds[2];
+	fds[0].fd=listenFd;
+	fds[0].events=POLLIN;
+	fds[1].fd=stopPipe[0];
+	fds[1].events=POLLIN;
+
+	while(true){
+		fds[0].revents=fds[1].revents=0;
+		if(poll(fds, 2, -1)<0){
+			if(errno==EINTR) continue;
+			break;
+		}
+		if(fds[1].revents!=0) break;	//stop
+		if(fds[0].revents==0) continue;
+
+		int fd=accept(listenFd, nullptr, nullptr);
+		if(fd<0) continue;
+
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		clients.insert(fd);
+		std::thread(&Server::serve, this, fd).detach();
+	}
+
+	//disconnect clients and wait for their threads
+	std::unique_lock<std::mutex> lock(clientsMutex);
+	for(int fd : clients) shutdown(fd, SHUT_RDWR);
+	noClients.wait(lock, [this](){ return clients.empty(); });
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+}
+
+void Server::serve(int fd){
+	CGP cgp(1, 1);	//only applies compiled filters, so dimensions do not matter
+	cgp.setThreadPool(&pool);
+
+	std::vector<uint8_t> in;	//request data
+	std::vector<uint8_t> out;	//response (buffers are reused by next requests)
+	Image img;
+
+	//previous raw frame, consecutive frames are filtered incrementally
+	std::vector<uint8_t> prevIn;
+	uint64_t prevId=0;
+	uint32_t prevWidth=0, prevHeight=0;
+	bool prevValid=false;
+
+	//sends error response
+	auto error=[&](const std::string& msg){
+		uint32_t len=msg.size();
+		uint8_t status=STATUS_ERROR;
+		return writeAll(fd, &status, 1) && writeAll(fd, &len, sizeof(len)) && writeAll(fd, msg.data(), len);
+	};
+
+	try{
+		for(Request type; readAll(fd, &type, 1); ++requests){
+			if(type==Request::LOAD){
+				uint32_t len;
+				if(!readAll(fd, &len, sizeof(len)) || len>MAX_PAYLOAD) break;
+				std::string chromosomePath(len, ' ');
+				if(!readAll(fd, &chromosomePath[0], len)) break;
+
+				uint64_t id;
+				try{
+					id=load(chromosomePath);
+				}catch(const std::runtime_error& e){
+					if(!error(e.what())) break;
+					continue;
+				}
+				uint8_t status=STATUS_OK;
+				if(!writeAll(fd, &status, 1) || !writeAll(fd, &id, sizeof(id))) break;
+
+			}else if(type==Request::FILTER_RAW){
+				uint8_t header[sizeof(uint64_t)+2*sizeof(uint32_t)];
+				if(!readAll(fd, header, sizeof(header))) break;
+				uint64_t id;
+				uint32_t width, height;
+				std::memcpy(&id, header, sizeof(id));
+				std::memcpy(&width, header+sizeof(id), sizeof(width));
+				std::memcpy(&height, header+sizeof(id)+sizeof(width), sizeof(height));
+				if(static_cast<uint64_t>(width)*height>MAX_PAYLOAD) break;
+
+				in.resize(static_cast<uint64_t>(width)*height);
+				if(!readAll(fd, in.data(), in.size())) break;
+
+				std::shared_ptr<const CGP::Program> p;
+				try{
+					p=filter(id);
+				}catch(const std::runtime_error& e){
+					prevValid=false;
+					if(!error(e.what())) break;
+					continue;
+				}
+
+				//status, width, height and pixels are sent at once
+				const uint64_t pixelsOffset=1+2*sizeof(uint32_t);
+				out.resize(pixelsOffset+in.size());
+				out[0]=STATUS_OK;
+				std::memcpy(&out[1], &width, sizeof(width));
+				std::memcpy(&out[1+sizeof(width)], &height, sizeof(height));
+				if(prevValid && prevId==id && prevWidth==width && prevHeight==height){
+					//out still contains result of previous frame
+					cgp.useFilter(*p, in.data(), prevIn.data(), width, height, out.data()+pixelsOffset);
+				}else{
+					cgp.useFilter(*p, in.data(), width, height, out.data()+pixelsOffset);
+				}
+				in.swap(prevIn);
+				prevId=id;
+				prevWidth=width;
+				prevHeight=height;
+				prevValid=true;
+				if(!writeAll(fd, out.data(), out.size())) break;
+
+			}else if(type==Request::FILTER_IMAGE){
+				uint8_t header[sizeof(uint64_t)+sizeof(uint32_t)];
+				if(!readAll(fd, header, sizeof(header))) break;
+				uint64_t id;
+				uint32_t len;
+				std::memcpy(&id, header, sizeof(id));
+				std::memcpy(&len, header+sizeof(id), sizeof(len));
+				if(len>MAX_PAYLOAD) break;
+
+				in.resize(len);
+				if(!readAll(fd, in.data(), in.size())) break;
+
+				std::vector<uint8_t> encoded;
+				prevValid=false;	//out is overwritten
+				try{
+					std::shared_ptr<const CGP::Program> p=filter(id);
+					img.decode(in.data(), in.size());
+					cgp.useFilter(*p, img, out);
+					encoded=Image(img.getWidth(), img.getHeight(), out).encode();
+				}catch(const std::runtime_error& e){
+					if(!error(e.what())) break;
+					continue;
+				}
+
+				uint8_t status=STATUS_OK;
+				len=encoded.size();
+				if(!writeAll(fd, &status, 1) || !writeAll(fd, &len, sizeof(len))
+						|| !writeAll(fd, encoded.data(), encoded.size())) break;
+			}else{
+				//unknown request, we can not continue
+				break;
+			}
+		}
+	}catch(const std::exception& e){
+		error(e.what());
+	}
+
+	std::lock_guard<std::mutex> lock(clientsMutex);
+	close(fd);
+	clients.erase(fd);
+	if(clients.empty()) noClients.notify_all();
+}
+
+uint64_t Server::load(const std::string& chromosomePath){
+	//file comes from client, so nothing is trusted
+	std::ifstream f(chromosomePath, std::ios::binary | std::ios::ate);
+	const std::streamoff size=f.tellg();
+	f.seekg(0);
+	uint32_t cols=0, rows=0;
+	f.read(reinterpret_cast<char *>(&cols), sizeof(cols));
+	f.read(reinterpret_cast<char *>(&rows), sizeof(rows));
+	if(!f || cols==0 || rows==0
+			|| CGP::PARAM_IN+static_cast<uint64_t>(cols)*rows>std::numeric_limits<uint16_t>::max()
+			|| size<0 || static_cast<uint64_t>(size)<2*sizeof(uint32_t)
+				+sizeof(uint32_t)*(CGP::CHROMOSOME_BLOCK_SIZE*static_cast<uint64_t>(cols)*rows+CGP::PARAM_OUT)){
+		throw std::runtime_error("Invalid chromosome: "+chromosomePath);
+	}
+
+	Chromosome c(CGP::CHROMOSOME_BLOCK_SIZE*cols*rows+CGP::PARAM_OUT);
+	if(!f.read(reinterpret_cast<char *>(&c[0]), sizeof(uint32_t)*c.size())){
+		throw std::runtime_error("Could not load chromosome: "+chromosomePath);
+	}
+	if(!CGP::valid(c, cols, rows)) throw std::runtime_error("Invalid chromosome: "+chromosomePath);
+
+	uint64_t id=hash(c, cols, rows);
+	std::lock_guard<std::mutex> lock(filtersMutex);
+	if(filters.find(id)==filters.end()){
+		filters[id]=std::make_shared<const CGP::Program>(CGP::compile(c));
+	}
+	return id;
+}
+
+std::shared_ptr<const CGP::Program> Server::filter(uint64_t id){
+	std::lock_guard<std::mutex> lock(filtersMutex);
+	auto it=filters.find(id);
+	if(it==filters.end()) throw std::runtime_error("Unknown filter (load it first).");
+	return it->second;
+}
+
+uint64_t Server::hash(const Chromosome& c, uint32_t cols, uint32_t rows){
+	uint64_t h=14695981039346656037ULL;
+	auto add=[&h](uint32_t v){
+		for(unsigned i=0; i<sizeof(v); ++i){
+			h^=(v>>(8*i)) & 0xFF;
+			h*=1099511628211ULL;
+		}
+	};
+
+	add(cols);
+	add(rows);
+	for(uint32_t g : c) add(g);
+	return h;
+}
+
+ServerClient::ServerClient(const std::string& path){
+	sockaddr_un addr=socketAddress(path);
+	fd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd<0) throw std::runtime_error("Could not create socket.");
+	if(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))<0){
+		close(fd);
+		throw std::runtime_error("Could not connect to: "+path);
+	}
+}
+
+ServerClient::~ServerClient(){
+	close(fd);
+}
+
+void ServerClient::checkStatus(){
+	uint8_t status;
+	if(!readAll(fd, &status, 1)) throw std::runtime_error("Connection to server was closed.");
+	if(status==Server::STATUS_OK) return;
+
+	uint32_t len;
+	std::string msg;
+	if(readAll(fd, &len, sizeof(len)) && len<=Server::MAX_PAYLOAD){
+		msg.resize(len);
+		readAll(fd, &msg[0], len);
+	}
+	throw std::runtime_error("Server error: "+msg);
+}
+
+uint64_t ServerClient::load(const std::string& chromosomePath){
+	Server::Request type=Server::Request::LOAD;
+	uint32_t len=chromosomePath.size();
+	if(!writeAll(fd, &type, 1) || !writeAll(fd, &len, sizeof(len)) || !writeAll(fd, chromosomePath.data(), len)){
+		throw std::runtime_error("Could not send request.");
+	}
+
+	checkStatus();
+	uint64_t id;
+	if(!readAll(fd, &id, sizeof(id))) throw std::runtime_error("Connection to server was closed.");
+	return id;
+}
+
+void ServerClient::filter(uint64_t id, const uint8_t* px, uint32_t width, uint32_t height, uint8_t* res){
+	uint8_t header[1+sizeof(uint64_t)+2*sizeof(uint32_t)];
+	header[0]=static_cast<uint8_t>(Server::Request::FILTER_RAW);
+	std::memcpy(header+1, &id, sizeof(id));
+	std::memcpy(header+1+sizeof(id), &width, sizeof(width));
+	std::memcpy(header+1+sizeof(id)+sizeof(width), &height, sizeof(height));
+	if(!writeAll(fd, header, sizeof(header)) || !writeAll(fd, px, static_cast<uint64_t>(width)*height)){
+		throw std::runtime_error("Could not send request.");
+	}
+
+	checkStatus();
+	uint32_t size[2];
+	if(!readAll(fd, size, sizeof(size)) || size[0]!=width || size[1]!=height
+			|| !readAll(fd, res, static_cast<uint64_t>(width)*height)){
+		throw std::runtime_error("Invalid response.");
+	}
+}
+
+std::vector<uint8_t> ServerClient::filter(uint64_t id, const std::vector<uint8_t>& encoded){
+	uint8_t header[1+sizeof(uint64_t)+sizeof(uint32_t)];
+	uint32_t len=encoded.size();
+	header[0]=static_cast<uint8_t>(Server::Request::FILTER_IMAGE);
+	std::memcpy(header+1, &id, sizeof(id));
+	std::memcpy(header+1+sizeof(id), &len, sizeof(len));
+	if(!writeAll(fd, header, sizeof(header)) || !writeAll(fd, encoded.data(), encoded.size())){
+		throw std::runtime_error("Could not send request.");
+	}
+
+	checkStatus();
+	if(!readAll(fd, &len, sizeof(len)) || len>Server::MAX_PAYLOAD) throw std::runtime_error("Invalid response.");
+	std::vector<uint8_t> res(len);
+	if(!readAll(fd, res.data(), len)) throw std::runtime_error("Invalid response.");
+	return res;
+}
+
+/*** End of file: Server.cpp ***/
@@ -0,0 +1,218 @@
+/**
+ * Project: EDEF
+ * @file Server.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for filter daemon on Unix domain socket and its client.
+ */
+
+#ifndef SRC_SERVER_H_
+#define SRC_SERVER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "CGP.h"
+#include "ThreadPool.h"
+
+/**
+ * Long-running filter daemon.
+ * Keeps compiled filters and warm thread pool, so requests are not slowed down by program start,
+ * chromosome loading and analysis.
+ *
+ * Protocol (all numbers are unsigned in host byte order, it is local socket):
+ * 	Request starts with one byte of request type:
+ * 		LOAD: uint32 length, path to chromosome
+ * 			Response: status, uint64 filter id (hash of chromosome)
+ * 		FILTER_RAW: uint64 filter id, uint32 width, uint32 height, width*height grayscale pixels
+ * 			Response: status, uint32 width, uint32 height, width*height filtered pixels
+ * 		FILTER_IMAGE: uint64 filter id, uint32 length, encoded image (jpg, png, ...)
+ * 			Response: status, uint32 length, filtered image encoded as jpg
+ * 	Response starts with one byte of status. When status is STATUS_ERROR it is followed
+ * 	by uint32 length and error message instead of the response data.
+ * Filter id is hash of chromosome, so clients that already know it do not need to load the filter again.
+ * Each connection is served by its own thread and may send any number of requests.
+ */
+class Server {
+public:
+	/**
+	 * Types of requests.
+	 */
+	enum class Request : uint8_t {
+		LOAD=1, //! Load chromosome from file.
+		FILTER_RAW=2, //! Filter raw grayscale pixels.
+		FILTER_IMAGE=3 //! Filter encoded image.
+	};
+
+	static const uint8_t STATUS_OK=0;	//! request was performed
+	static const uint8_t STATUS_ERROR=1;	//! request failed, error message follows
+	static const uint32_t MAX_PAYLOAD=1u<<30;	//! maximal size of data in one request
+
+	/**
+	 * Creates socket.
+	 *
+	 * @param[in] path
+	 * 	Path to Unix domain socket.
+	 * @param[in] threads
+	 * 	Number of threads in pool that filters images.
+	 * @throw std::runtime_error	When socket could not be created.
+	 */
+	Server(const std::string& path, unsigned threads);
+
+	/**
+	 * Closes and removes socket.
+	 */
+	~Server();
+
+	Server(const Server&)=delete;
+	Server& operator=(const Server&)=delete;
+
+	/**
+	 * Serves clients until SIGINT or SIGTERM is received.
+	 */
+	void run();
+
+	/**
+	 * Number of performed requests.
+	 *
+	 * @return Number of requests.
+	 */
+	uint64_t getRequests() const {
+		return requests;
+	}
+
+	/**
+	 * Hash of chromosome (FNV-1a).
+	 *
+	 * @param[in] c
+	 * 	The chromosome.
+	 * @param[in] cols
+	 * 	Number of columns.
+	 * @param[in] rows
+	 * 	Number of rows.
+	 * @return The hash.
+	 */
+	static uint64_t hash(const Chromosome& c, uint32_t cols, uint32_t rows);
+
+private:
+	std::string path;	//! path to socket
+	int listenFd=-1;	//! listening socket
+	ThreadPool pool;	//! warm threads for filtering
+	std::map<uint64_t, std::shared_ptr<const CGP::Program>> filters;	//! compiled filters by hash
+	std::mutex filtersMutex;	//! guards filters
+	std::set<int> clients;	//! sockets of connected clients
+	std::mutex clientsMutex;	//! guards clients
+	std::condition_variable noClients;	//! last client disconnected
+	std::atomic<uint64_t> requests;	//! number of performed requests
+
+	/**
+	 * Serves one client until it disconnects.
+	 *
+	 * @param[in] fd
+	 * 	Socket of client.
+	 */
+	void serve(int fd);
+
+	/**
+	 * Loads and compiles chromosome (if it is not loaded yet).
+	 * Size of the file, dimensions and all genes are checked before the filter is compiled.
+	 *
+	 * @param[in] chromosomePath
+	 * 	Path to chromosome.
+	 * @return Filter id.
+	 * @throw std::runtime_error	When chromosome could not be loaded or it is invalid.
+	 */
+	uint64_t load(const std::string& chromosomePath);
+
+	/**
+	 * Finds loaded filter.
+	 *
+	 * @param[in] id
+	 * 	Filter id.
+	 * @return The filter.
+	 * @throw std::runtime_error	When there is no such filter.
+	 */
+	std::shared_ptr<const CGP::Program> filter(uint64_t id);
+};
+
+/**
+ * Client of filter daemon.
+ */
+class ServerClient {
+public:
+	/**
+	 * Connects to daemon.
+	 *
+	 * @param[in] path
+	 * 	Path to Unix domain socket.
+	 * @throw std::runtime_error	When could not connect.
+	 */
+	ServerClient(const std::string& path);
+
+	/**
+	 * Disconnects.
+	 */
+	~ServerClient();
+
+	ServerClient(const ServerClient&)=delete;
+	ServerClient& operator=(const ServerClient&)=delete;
+
+	/**
+	 * Loads chromosome on daemon.
+	 *
+	 * @param[in] chromosomePath
+	 * 	Path to chromosome (daemon must be able to read it).
+	 * @return Filter id.
+	 * @throw std::runtime_error	When daemon could not load it or communication failed.
+	 */
+	uint64_t load(const std::string& chromosomePath);
+
+	/**
+	 * Filters raw grayscale pixels.
+	 *
+	 * @param[in] id
+	 * 	Filter id.
+	 * @param[in] px
+	 * 	Pixels.
+	 * @param[in] width
+	 * 	Image width.
+	 * @param[in] height
+	 * 	Image height.
+	 * @param[out] res
+	 * 	Filtered pixels (width*height).
+	 * @throw std::runtime_error	When request failed.
+	 */
+	void filter(uint64_t id, const uint8_t* px, uint32_t width, uint32_t height, uint8_t* res);
+
+	/**
+	 * Filters encoded image.
+	 *
+	 * @param[in] id
+	 * 	Filter id.
+	 * @param[in] encoded
+	 * 	Encoded image (jpg, png, ...).
+	 * @return Filtered image encoded as jpg.
+	 * @throw std::runtime_error	When request failed.
+	 */
+	std::vector<uint8_t> filter(uint64_t id, const std::vector<uint8_t>& encoded);
+
+private:
+	int fd=-1;	//! connected socket
+
+	/**
+	 * Reads status of response and throws when it is error.
+	 *
+	 * @throw std::runtime_error	When status is error or communication failed.
+	 */
+	void checkStatus();
+};
+
+#endif /* SRC_SERVER_H_ */
+
+/*** End of file: Server.h ***/
@@ -0,0 +1,154 @@
+/**
+ * Project: EDEF
+ * @file ShmRing.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for ring of frame slots in POSIX shared memory.
+ */
+
+#include "ShmRing.h"
+#include <stdexcept>
+#include <cerrno>
+#include <ctime>
+#include <climits>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static_assert(sizeof(ShmRing::Header)<=ShmRing::HEADER_SIZE, "Header of ring does not fit.");
+static_assert(sizeof(std::atomic<uint32_t>)==sizeof(uint32_t), "Counters can not be used as futex words.");
+
+ShmRing::ShmRing(const std::string& name): name(name), owner(false){
+	int fd=shm_open(name.c_str(), O_RDWR, 0);
+	if(fd<0) throw std::runtime_error("Could not open shared memory: "+name);
+
+	struct stat st;
+	if(fstat(fd, &st)<0 || static_cast<uint64_t>(st.st_size)<HEADER_SIZE){
+		close(fd);
+		throw std::runtime_error("Invalid shared memory ring: "+name);
+	}
+	size=st.st_size;
+	map(fd);
+
+	if(header->magic!=MAGIC || header->version!=VERSION || header->slots==0
+			|| (header->slots&(header->slots-1))!=0
+			|| header->slotSize<static_cast<uint64_t>(header->width)*header->height
+			|| HEADER_SIZE+2*header->slots*header->slotSize>size){
+		munmap(base, size);
+		throw std::runtime_error("Invalid shared memory ring: "+name);
+	}
+}
+
+ShmRing::ShmRing(const std::string& name, uint32_t width, uint32_t height, uint32_t slots): name(name), owner(true){
+	if(width==0 || height==0 || slots==0) throw std::invalid_argument("Invalid size of ring.");
+	//frame counters wrap at 2^32, slot of frame must not change then
+	if((slots&(slots-1))!=0) throw std::invalid_argument("Number of ring slots must be power of two.");
+
+	uint64_t slotSize=(static_cast<uint64_t>(width)*height+63)/64*64;
+	size=HEADER_SIZE+2*slots*slotSize;
+
+	int fd=shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd<0) throw std::runtime_error("Could not create shared memory: "+name);
+	if(ftruncate(fd, size)<0){
+		close(fd);
+		shm_unlink(name.c_str());
+		throw std::runtime_error("Could not create shared memory: "+name);
+	}
+	try{
+		map(fd);
+	}catch(...){
+		shm_unlink(name.c_str());
+		throw;
+	}
+
+	header=new (base) Header;
+	header->width=width;
+	header->height=height;
+	header->slots=slots;
+	header->slotSize=slotSize;
+	header->stop.store(0);
+	header->written.store(0);
+	header->filtered.store(0);
+	header->consumed.store(0);
+	header->version=VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic=MAGIC;
+}
+
+ShmRing::~ShmRing(){
+	munmap(base, size);
+	if(owner) shm_unlink(name.c_str());
+}
+
+void ShmRing::map(int fd){
+	void* mem=mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mem==MAP_FAILED) throw std::runtime_error("Could not map shared memory: "+name);
+	base=static_cast<uint8_t*>(mem);
+	header=reinterpret_cast<Header*>(base);
+}
+
+void ShmRing::sleep(std::atomic<uint32_t>& counter, uint32_t value){
+	timespec timeout;
+	timeout.tv_sec=0;
+	timeout.tv_nsec=WAIT_MS*1000000L;
+	//not private futex, the word is shared among processes
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&counter), FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+void ShmRing::wake(std::atomic<uint32_t>& counter){
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&counter), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void ShmRing::increment(std::atomic<uint32_t>& counter){
+	counter.fetch_add(1, std::memory_order_release);
+	wake(counter);
+}
+
+bool ShmRing::waitInput(uint32_t frame){
+	while(true){
+		uint32_t written=header->written.load(std::memory_order_acquire);
+		if(static_cast<int32_t>(written-frame)>0) return true;
+		if(header->stop.load(std::memory_order_acquire)!=0) return false;
+		sleep(header->written, written);
+	}
+}
+
+void ShmRing::publishOutput(){
+	increment(header->filtered);
+}
+
+void ShmRing::waitSlot(uint32_t frame){
+	while(true){
+		uint32_t consumed=header->consumed.load(std::memory_order_acquire);
+		if(frame-consumed<header->slots) return;
+		sleep(header->consumed, consumed);
+	}
+}
+
+void ShmRing::publishInput(){
+	increment(header->written);
+}
+
+void ShmRing::waitOutput(uint32_t frame){
+	while(true){
+		uint32_t filtered=header->filtered.load(std::memory_order_acquire);
+		if(static_cast<int32_t>(filtered-frame)>0) return;
+		sleep(header->filtered, filtered);
+	}
+}
+
+void ShmRing::release(){
+	increment(header->consumed);
+}
+
+void ShmRing::stop(){
+	header->stop.store(1, std::memory_order_release);
+	wake(header->written);
+}
+
+/*** End of file: ShmRing.cpp ***/
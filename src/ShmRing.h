@@ -0,0 +1,225 @@
+/**
+ * Project: EDEF
+ * @file ShmRing.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for ring of frame slots in POSIX shared memory.
+ */
+
+#ifndef SRC_SHMRING_H_
+#define SRC_SHMRING_H_
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+
+/**
+ * Ring of frame slots in POSIX shared memory (shm_open), shared by producer of frames
+ * (e.g. camera ingest process) and EDEF, that filters them. Pixels are never copied,
+ * EDEF reads input slot and writes the result directly to output slot.
+ *
+ * Layout of shared memory object:
+ * 	Header (HEADER_SIZE bytes, see Header)
+ * 	input slots (slots*slotSize bytes), frame i is in slot i%slots
+ * 	output slots (slots*slotSize bytes), result of frame i is in slot i%slots
+ * Number of slots is power of two, so slot of frame is the same after 32 bit counter overflows.
+ * Slot contains width*height grayscale pixels (one byte per pixel, rows are not padded).
+ *
+ * Synchronization uses three frame counters, which are also futex words (so waiting sides sleep in kernel):
+ * 	written: producer wrote input of frames 0..written-1
+ * 	filtered: EDEF wrote output of frames 0..filtered-1
+ * 	consumed: producer does not need slots of frames 0..consumed-1 anymore
+ * Producer may write frame i when i-consumed<slots. Counters are 32 bit and compared by differences,
+ * so they may overflow.
+ */
+class ShmRing {
+public:
+	static const uint32_t MAGIC=0x47524445;	//! "EDRG"
+	static const uint32_t VERSION=1;	//! version of layout
+	static const uint64_t HEADER_SIZE=256;	//! size of header (slots are aligned)
+
+	/**
+	 * Header at the beginning of shared memory.
+	 */
+	struct Header {
+		uint32_t magic;	//! MAGIC
+		uint32_t version;	//! VERSION
+		uint32_t width;	//! frame width
+		uint32_t height;	//! frame height
+		uint32_t slots;	//! number of slots
+		std::atomic<uint32_t> stop;	//! nonzero when producer ends
+		uint64_t slotSize;	//! size of slot in bytes (width*height rounded up to 64)
+		alignas(64) std::atomic<uint32_t> written;	//! number of written input frames
+		alignas(64) std::atomic<uint32_t> filtered;	//! number of filtered frames
+		alignas(64) std::atomic<uint32_t> consumed;	//! number of released frames
+	};
+
+	/**
+	 * Attaches to existing ring (EDEF side).
+	 *
+	 * @param[in] name
+	 * 	Name of shared memory object (/name).
+	 * @throw std::runtime_error	When ring does not exist or is invalid.
+	 */
+	ShmRing(const std::string& name);
+
+	/**
+	 * Creates new ring (producer side). It is removed when this object is destroyed.
+	 *
+	 * @param[in] name
+	 * 	Name of shared memory object (/name).
+	 * @param[in] width
+	 * 	Frame width.
+	 * @param[in] height
+	 * 	Frame height.
+	 * @param[in] slots
+	 * 	Number of slots. Must be power of two.
+	 * @throw std::invalid_argument	When size of ring is invalid.
+	 * @throw std::runtime_error	When ring could not be created.
+	 */
+	ShmRing(const std::string& name, uint32_t width, uint32_t height, uint32_t slots);
+
+	/**
+	 * Detaches from ring.
+	 */
+	~ShmRing();
+
+	ShmRing(const ShmRing&)=delete;
+	ShmRing& operator=(const ShmRing&)=delete;
+
+	/**
+	 * Waits until input of frame is written (EDEF side).
+	 *
+	 * @param[in] frame
+	 * 	The frame.
+	 * @return False when producer stopped and there are no more frames.
+	 */
+	bool waitInput(uint32_t frame);
+
+	/**
+	 * Marks output of next frame as filtered (EDEF side).
+	 */
+	void publishOutput();
+
+	/**
+	 * Waits until slot for frame is free (producer side).
+	 *
+	 * @param[in] frame
+	 * 	The frame.
+	 */
+	void waitSlot(uint32_t frame);
+
+	/**
+	 * Marks input of next frame as written (producer side).
+	 */
+	void publishInput();
+
+	/**
+	 * Waits until output of frame is filtered (producer side).
+	 *
+	 * @param[in] frame
+	 * 	The frame.
+	 */
+	void waitOutput(uint32_t frame);
+
+	/**
+	 * Releases slots of next frame (producer side).
+	 */
+	void release();
+
+	/**
+	 * Tells EDEF that there will be no more frames (producer side).
+	 */
+	void stop();
+
+	/**
+	 * Input slot of frame.
+	 *
+	 * @param[in] frame
+	 * 	The frame.
+	 * @return Pixels.
+	 */
+	uint8_t* getInput(uint32_t frame) {
+		return base+HEADER_SIZE+(frame&(header->slots-1))*header->slotSize;
+	}
+
+	/**
+	 * Output slot of frame.
+	 *
+	 * @param[in] frame
+	 * 	The frame.
+	 * @return Pixels.
+	 */
+	uint8_t* getOutput(uint32_t frame) {
+		return base+HEADER_SIZE+(header->slots+(frame&(header->slots-1)))*header->slotSize;
+	}
+
+	uint32_t getWidth() const {
+		return header->width;
+	}
+
+	uint32_t getHeight() const {
+		return header->height;
+	}
+
+	uint32_t getSlots() const {
+		return header->slots;
+	}
+
+	/**
+	 * Number of filtered frames.
+	 *
+	 * @return Number of frames.
+	 */
+	uint32_t getFiltered() const {
+		return header->filtered.load(std::memory_order_acquire);
+	}
+
+private:
+	static const int WAIT_MS=100;	//! longest sleep of one wait (stop flag is checked after it)
+
+	std::string name;	//! name of shared memory object
+	bool owner;	//! ring was created by this object
+	uint8_t* base=nullptr;	//! mapped memory
+	uint64_t size=0;	//! size of mapped memory
+	Header* header=nullptr;	//! header in mapped memory
+
+	/**
+	 * Maps shared memory object.
+	 *
+	 * @param[in] fd
+	 * 	Shared memory object.
+	 * @throw std::runtime_error	When it could not be mapped.
+	 */
+	void map(int fd);
+
+	/**
+	 * Sleeps until counter changes or WAIT_MS elapses.
+	 *
+	 * @param[in] counter
+	 * 	The counter (futex word).
+	 * @param[in] value
+	 * 	Value that was seen.
+	 */
+	static void sleep(std::atomic<uint32_t>& counter, uint32_t value);
+
+	/**
+	 * Wakes up all that wait for counter.
+	 *
+	 * @param[in] counter
+	 * 	The counter (futex word).
+	 */
+	static void wake(std::atomic<uint32_t>& counter);
+
+	/**
+	 * Increments counter and wakes up waiting ones.
+	 *
+	 * @param[in] counter
+	 * 	The counter (futex word).
+	 */
+	static void increment(std::atomic<uint32_t>& counter);
+};
+
+#endif /* SRC_SHMRING_H_ */
+
+/*** End of file: ShmRing.h ***/
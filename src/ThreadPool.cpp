@@ -0,0 +1,84 @@
+/**
+ * Project: EDEF
+ * @file ThreadPool.cpp
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Source file for simple pool of working threads.
+ */
+
+#include "ThreadPool.h"
+#include <utility>
+
+ThreadPool::ThreadPool(unsigned threads): nextTask(0){
+	for(unsigned t=1; t<threads; ++t){
+		workers.emplace_back(&ThreadPool::worker, this, t);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop=true;
+	}
+	jobCv.notify_all();
+	for(auto& w : workers){
+		w.join();
+	}
+}
+
+void ThreadPool::run(uint64_t tasks, const Task& task){
+	std::lock_guard<std::mutex> runLock(runMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job=&task;
+		jobTasks=tasks;
+		nextTask=0;
+		active=workers.size();
+		error=nullptr;
+		++generation;
+	}
+	jobCv.notify_all();
+
+	work(0);
+
+	std::exception_ptr jobError;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCv.wait(lock, [this](){ return active==0; });
+		job=nullptr;
+		std::swap(jobError, error);
+	}
+	if(jobError) std::rethrow_exception(jobError);
+}
+
+void ThreadPool::worker(unsigned thread){
+	uint64_t seen=0;	//last seen job
+	while(true){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobCv.wait(lock, [&](){ return stop || generation!=seen; });
+			if(stop) return;
+			seen=generation;
+		}
+
+		work(thread);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--active==0) doneCv.notify_one();
+	}
+}
+
+void ThreadPool::work(unsigned thread){
+	try{
+		for(uint64_t t=nextTask++; t<jobTasks; t=nextTask++){
+			(*job)(t, thread);
+		}
+	}catch(...){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!error) error=std::current_exception();
+		nextTask=jobTasks;	//remaining tasks are skipped
+	}
+}
+
+/*** End of file: ThreadPool.cpp ***/
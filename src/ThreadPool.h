@@ -0,0 +1,107 @@
+/**
+ * Project: EDEF
+ * @file ThreadPool.h
+ * @date 19. 10. 2026
+ * @author agent
+ * @brief Header file for simple pool of working threads.
+ */
+
+#ifndef SRC_THREADPOOL_H_
+#define SRC_THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+/**
+ * Fixed pool of working threads.
+ * Threads are created once and wait for jobs, so they are warm
+ * when a job comes.
+ */
+class ThreadPool {
+public:
+	/**
+	 * Job task. Gets index of task and index of thread that performs it.
+	 * Thread index is lower than size of the pool, so it can be used
+	 * for selecting per thread scratch memory.
+	 */
+	typedef std::function<void(uint64_t task, unsigned thread)> Task;
+
+	/**
+	 * Creates pool.
+	 *
+	 * @param[in] threads
+	 * 	Number of threads (including the one that calls run).
+	 */
+	ThreadPool(unsigned threads);
+
+	/**
+	 * Stops all threads.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&)=delete;
+	ThreadPool& operator=(const ThreadPool&)=delete;
+
+	/**
+	 * Performs tasks 0..tasks-1 and waits until all of them are done.
+	 * Calling thread works too (as thread 0).
+	 * Jobs from multiple threads are performed one after another.
+	 * When a task throws, tasks that were not taken yet are skipped and the first
+	 * exception is rethrown after all threads finished the job.
+	 *
+	 * @param[in] tasks
+	 * 	Number of tasks.
+	 * @param[in] task
+	 * 	The task.
+	 */
+	void run(uint64_t tasks, const Task& task);
+
+	/**
+	 * Number of threads.
+	 *
+	 * @return Number of threads (including the one that calls run).
+	 */
+	unsigned size() const {
+		return workers.size()+1;
+	}
+
+private:
+	std::vector<std::thread> workers;	//! working threads
+	std::mutex runMutex;	//! only one job at time
+	std::mutex mutex;	//! guards job state
+	std::condition_variable jobCv;	//! new job or stop
+	std::condition_variable doneCv;	//! workers finished job
+	const Task* job=nullptr;	//! actual job
+	uint64_t jobTasks=0;	//! number of tasks in actual job
+	std::atomic<uint64_t> nextTask;	//! next task that is not taken yet
+	uint64_t generation=0;	//! job counter
+	unsigned active=0;	//! workers that still work on actual job
+	std::exception_ptr error;	//! first exception thrown by task of actual job
+	bool stop=false;	//! pool is stopping
+
+	/**
+	 * Main loop of worker.
+	 *
+	 * @param[in] thread
+	 * 	Index of thread.
+	 */
+	void worker(unsigned thread);
+
+	/**
+	 * Takes tasks of actual job until there are none.
+	 *
+	 * @param[in] thread
+	 * 	Index of thread.
+	 */
+	void work(unsigned thread);
+};
+
+#endif /* SRC_THREADPOOL_H_ */
+
+/*** End of file: ThreadPool.h ***/
@@ -11,10 +11,26 @@
 #include <sstream>
 #include <vector>
 #include <set>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <cmath>
+#include <limits>
+#include <mutex>
 
 #include "Config.h"
 #include "Image.h"
 #include "CGP.h"
+#include "PGM.h"
+#include "ThreadPool.h"
+#include "Batch.h"
+#include "Campaign.h"
+#include "FrameStream.h"
+#include "Server.h"
+#include "ShmRing.h"
 
 /**
  * Class that manages input arguments and program help.
@@ -33,6 +49,12 @@ public:
 		TEST,	//! Test filter on testing set.
 		STATUS, //! Get filter status.
 		USE, //! Use filter on image.
+		STREAM, //! Use filter on frames from stdin.
+		SERVE, //! Filter daemon.
+		CLIENT, //! Client of filter daemon.
+		SHM, //! Use filter on frames in shared memory ring.
+		CAMPAIGN, //! Fault-injection campaign.
+		HARDEN, //! Search for alternative implementations of filter.
 		HELP	//! Show help.
 	};
 
@@ -44,6 +66,8 @@ public:
 	 * @throw std::invalid_argument When arguments are invalid.
 	 */
 	Args(int argc, char** argv){
+		bool fillSet=false;	//-fill was given
+
 		//arguments parsing
 		for(int i=1; i<argc; i++){
 			std::string actArg(argv[i]);
@@ -67,6 +91,94 @@ public:
 			}else if(actArg=="-use"){
 				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
 				action=USE;
+			}else if(actArg=="-stream"){
+				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
+				action=STREAM;
+			}else if(actArg=="-serve" || actArg=="-client"){
+				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
+				action= actArg=="-serve" ? SERVE : CLIENT;
+				if(++i>=argc) throw std::invalid_argument("Must specify path to socket.");
+				socket=argv[i];
+			}else if(actArg=="-shm"){
+				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
+				action=SHM;
+				if(++i>=argc) throw std::invalid_argument("Must specify name of shared memory.");
+				socket=argv[i];
+			}else if(actArg=="-roi"){
+				if(++i>=argc) throw std::invalid_argument("No value for roi.");
+				//read rectangles
+				while(i<argc && keyWords.find(argv[i])==keyWords.end()){
+					std::stringstream sConv(argv[i++]);
+					CGP::Rect r;
+					char c1=0, c2=0, c3=0;
+					if(!(sConv >> r.x >> c1 >> r.y >> c2 >> r.width >> c3 >> r.height) || c1!=',' || c2!=',' || c3!=','){
+						throw std::invalid_argument("Region of interest must be in format x,y,width,height.");
+					}
+					rois.push_back(r);
+				}
+				if(i < argc && keyWords.find(argv[i])!=keyWords.end()){
+					--i;
+				}
+			}else if(actArg=="-mask"){
+				if(++i>=argc) throw std::invalid_argument("Must specify mask image.");
+				mask=argv[i];
+			}else if(actArg=="-fill"){
+				if(++i>=argc) throw std::invalid_argument("No value for fill.");
+				std::stringstream sConv(argv[i]);
+				if(!(sConv >> fill) || fill>255){
+					throw std::invalid_argument("Fill must be number from 0 to 255.");
+				}
+				fillSet=true;
+			}else if(actArg=="-combine"){
+				if(++i>=argc) throw std::invalid_argument("No value for combine.");
+				std::string mode(argv[i]);
+				if(mode=="max"){
+					combine=CGP::Combine::MAX;
+				}else if(mode=="min"){
+					combine=CGP::Combine::MIN;
+				}else if(mode=="median"){
+					combine=CGP::Combine::MEDIAN;
+				}else if(mode=="mean"){
+					combine=CGP::Combine::MEAN;
+				}else{
+					throw std::invalid_argument("Combine must be one of: max, min, median, mean.");
+				}
+				ensemble=true;
+			}else if(actArg=="-repeat"){
+				if(++i>=argc) throw std::invalid_argument("No value for repeat.");
+				std::stringstream sConv(argv[i]);
+				if(!(sConv >> repeat) || repeat==0){
+					throw std::invalid_argument("Number of repetitions must be positive integer.");
+				}
+			}else if(actArg=="-campaign"){
+				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
+				action=CAMPAIGN;
+			}else if(actArg=="-harden"){
+				if(action!=NOPE) throw std::invalid_argument("You can not select multiple actions.");
+				action=HARDEN;
+			}else if(actArg=="-archive"){
+				if(++i>=argc){
+					throw std::invalid_argument("Must specify archive file that can be open for reading.");
+				}
+				archive.open(argv[i], std::ios::binary);
+				if(!archive){
+					throw std::invalid_argument("Must specify archive file that can be open for reading.");
+				}
+			}else if(actArg=="-pareto"){
+				pareto=true;
+			}else if(actArg=="-threads"){
+				if(++i>=argc) throw std::invalid_argument("No value for threads.");
+				std::stringstream sConv(argv[i]);
+				if(!(sConv >> threads) || threads==0){
+					throw std::invalid_argument("Number of threads must be positive integer.");
+				}
+			}else if(actArg=="-size"){
+				if(++i>=argc) throw std::invalid_argument("No value for size.");
+				std::stringstream sConv(argv[i]);
+				char x=0;
+				if(!(sConv >> width >> x >> height) || x!='x' || width==0 || height==0){
+					throw std::invalid_argument("Size must be in format WIDTHxHEIGHT.");
+				}
 			}else if(actArg=="-set"){
 				if(++i>=argc) throw std::invalid_argument("No value for set.");
 
@@ -91,10 +203,21 @@ public:
 				if(++i>=argc){
 					throw std::invalid_argument("Must specify chromosome file that can be open for reading.");
 				}
-				chromosome.open(argv[i], std::ios::binary);
-				if(!chromosome){
+				//read paths to chromosomes (more of them make cascade of filters)
+				while(i<argc && keyWords.find(argv[i])==keyWords.end()){
+					if(!std::ifstream(argv[i], std::ios::binary)){
+						throw std::invalid_argument("Must specify chromosome file that can be open for reading.");
+					}
+					chromosomePaths.push_back(argv[i++]);
+				}
+				if(i < argc && keyWords.find(argv[i])!=keyWords.end()){
+					--i;
+				}
+				if(chromosomePaths.empty()){
 					throw std::invalid_argument("Must specify chromosome file that can be open for reading.");
 				}
+				chromosome.open(chromosomePaths[0], std::ios::binary);
+				chromosomePath=chromosomePaths[0];
 
 			}else if(actArg=="-on"){
 				if(++i>=argc){
@@ -129,6 +252,18 @@ public:
 		}
 
 		//actions control
+		if(chromosomePaths.size()>1 && action!=USE && action!=TEST){
+			throw std::invalid_argument("Multiple chromosomes can be used only with -use and -test.");
+		}
+		if(ensemble && action!=USE){
+			throw std::invalid_argument("-combine can be used only with -use.");
+		}
+		if(!rois.empty() && !mask.empty()){
+			throw std::invalid_argument("-roi and -mask can not be used together.");
+		}
+		if(fillSet && rois.empty() && mask.empty()){
+			throw std::invalid_argument("-fill can be used only with -roi or -mask.");
+		}
 
 		switch (action) {
 			case TRAIN:
@@ -147,6 +282,8 @@ public:
 			case TEST:
 				if(set.size()==0 || setOut.size()==0 || !chromosome)
 					throw std::invalid_argument("-test needs: -set, -setOut, -chromosome.");
+				if(set.size()!=setOut.size())
+					throw std::invalid_argument("-set and -setOut must have the same number of images.");
 				break;
 			case STATUS:
 				if(!chromosome)
@@ -156,6 +293,26 @@ public:
 				if(!chromosome || on.size()==0 || out.size()==0)
 					throw std::invalid_argument("-use needs: -chromosome, -on, -out.");
 				break;
+			case STREAM:
+				if(!chromosome)
+					throw std::invalid_argument("-stream needs: -chromosome.");
+				break;
+			case SHM:
+				if(!chromosome)
+					throw std::invalid_argument("-shm needs: -chromosome.");
+				break;
+			case CLIENT:
+				if(!chromosome || on.size()==0)
+					throw std::invalid_argument("-client needs: -chromosome, -on.");
+				break;
+			case HARDEN:
+				if(set.size()==0 || setOut.size()==0 || !chromosome || config.empty() || out.size()==0)
+					throw std::invalid_argument("-harden needs: -set, -setOut, -chromosome, -config, -out.");
+				break;
+			case CAMPAIGN:
+				if(set.size()==0 || setOut.size()==0 || !chromosome || config.empty() || out.size()==0)
+					throw std::invalid_argument("-campaign needs: -set, -setOut, -chromosome, -config, -out.");
+				break;
 			case NOPE:
 				throw std::invalid_argument("No action.");
 				break;
@@ -165,33 +322,78 @@ public:
 	}
 
 	/**
-	 * Prints program help to stdout.
+	 * Prints program help.
+	 *
+	 * @param[out] out
+	 * 	Stream for writing.
 	 */
-	static void showHelp(){
-		std::cout << "Thank you for using "<< PROGRAM_NAME <<". "
+	static void showHelp(std::ostream& out=std::cout){
+		out << "Thank you for using "<< PROGRAM_NAME <<". "
 				<< "This program was developed at FIT BUT as project to course: Bio-Inspired Computers. \n\n"
 				<< "\t-train" <<"\n\t\tYou want to develop new edge detection filter on given training data set.\n"
-				<<"\t\tPROVIDE: -set, -setOut, -config, -out\n"
+				<<"\t\tWith -pareto it trades error against execution cost and saves whole Pareto front (out_N.bin).\n"
+				<<"\t\tPROVIDE: -set, -setOut, -config, -out [-pareto] [-threads]\n"
 				<< "\t-repair" <<"\n\t\tIt will try to find new implementation of filter with given resources (damaged before). \n"
+				<<"\t\tWhen -archive is given, archived alternative that avoids damaged blocks is used instead of evolution (if there is one).\n"
+				<<"\t\tPROVIDE: -set, -setOut, -chromosome, -config -out [-archive] [-threads]\n"
+				<< "\t-harden" <<"\n\t\tSearches for up to HARDEN_ALTERNATIVES alternative implementations of the filter that use disjoint sets of blocks\n"
+				<<"\t\tand are at most HARDEN_TOLERANCE (relative) worse. Saves them to archive (-out) for instant -repair.\n"
 				<<"\t\tPROVIDE: -set, -setOut, -chromosome, -config -out\n"
 				<< "\t-damage" <<"\n\t\tWill damage the existing filter. Randomly selects block and changes it to block with 0 output.\n"
 				<<"\t\tPROVIDE: -chromosome -out\n"
 				<< "\t-test" <<"\n\t\tYou want to test your developed filter on given testing data set.\n"
-				<<"\t\tPROVIDE: -set, -setOut, -chromosome\n"
-				<< "\t-status" <<"\n\t\tChecks filter state (how much it is damaged).\n"
-				<<"\t\tPROVIDE: -chromosome\n"
+				<<"\t\tWith more chromosomes all of them are scored in parallel on once loaded set and sorted table\n"
+				<<"\t\tof fitness and error on each image is written.\n"
+				<<"\t\tSingle chromosome is tested on stream of images (only few of them are in memory) and SAD, MSE and PSNR\n"
+				<<"\t\tof each image is written as CSV (to -out or stdout, then other output goes to stderr).\n"
+				<<"\t\tPROVIDE: -set, -setOut, -chromosome [-out] [-threads]\n"
+				<< "\t-status" <<"\n\t\tChecks filter state (how much it is damaged) and its static performance profile.\n"
+				<<"\t\tPROVIDE: -chromosome [-config]\n"
 				<< "\t-use" <<"\n\t\tUse filter on given image.\n"
-				<<"\t\tPROVIDE: -chromosome -on -out\n"
+				<<"\t\tWhen both -on and -out are binary PGM (.pgm) images, the image is streamed in bands of rows (bounded memory).\n"
+				<<"\t\tRows are split among -threads threads.\n"
+				<<"\t\tWhen -on is directory (or manifest .txt file with lines: input [output]), all jpg images are processed\n"
+				<<"\t\tby decode/filter/encode pipeline and saved to -out directory.\n"
+				<<"\t\tWith -roi or -mask only given regions are filtered and the rest of result is set to -fill.\n"
+				<<"\t\tWith more chromosomes the filters are applied one after another in one fused pass (no intermediate images).\n"
+				<<"\t\tWith -combine they are used as ensemble on the same image and their results are combined instead.\n"
+				<<"\t\tPROVIDE: -chromosome -on -out [-threads] [-roi] [-mask] [-fill] [-combine]\n"
+				<< "\t-stream" <<"\n\t\tUse filter on video frames from stdin and write filtered frames to stdout (pipeable with ffmpeg).\n"
+				<<"\t\tInput is y4m (luma is filtered, chroma is set to gray) or raw grayscale frames of -size.\n"
+				<<"\t\tPer-frame latency percentiles are written to stderr.\n"
+				<<"\t\tPROVIDE: -chromosome [-size] [-threads]\n"
+				<< "\t-serve" <<"\n\t\tRuns filter daemon on given Unix domain socket (until SIGINT/SIGTERM). It keeps compiled filters\n"
+				<<"\t\tand warm threads, so requests do not pay for program start.\n"
+				<<"\t\tPROVIDE: socket path [-threads]\n"
+				<< "\t-client" <<"\n\t\tSends image to filter daemon on given socket. PGM (.pgm) images are sent as raw pixels,\n"
+				<<"\t\tother images are sent encoded. Writes percentiles of request latency.\n"
+				<<"\t\tPROVIDE: socket path -chromosome -on [-out] [-repeat]\n"
+				<< "\t-shm" <<"\n\t\tAttaches to ring of frame slots in POSIX shared memory with given name (created by producer,\n"
+				<<"\t\tlayout is described in src/ShmRing.h) and filters frames from input slots to output slots until producer stops.\n"
+				<<"\t\tPROVIDE: name -chromosome [-threads]\n"
+				<< "\t-campaign" <<"\n\t\tFault-injection campaign. Damages the filter with patterns of CAMPAIGN_DAMAGE blocks\n"
+				<<"\t\t(all of them or CAMPAIGN_SAMPLES random ones) and repairs each pattern in parallel.\n"
+				<<"\t\tWrites fitness before/after repair and generations to recover as CSV.\n"
+				<<"\t\tPROVIDE: -set, -setOut, -chromosome, -config -out\n"
 
 
 				<< "\t-set" <<"\n\t\tPaths to images for train/test set (filled with jpg images).\n"
 				<< "\t-setOut" <<"\n\t\tPaths to images for required filter output. Image must be on same position as coresponding image from -set.\n"
 
-				<< "\t-on" <<"\n\t\tPath to image (jpg).\n"
+				<< "\t-on" <<"\n\t\tPath to image (jpg or pgm), directory with images or manifest (.txt).\n"
 				<< "\t-out" <<"\n\t\tPath to file for result.\n"
 
-				<< "\t-chromosome" <<"\n\t\tPath to saved chromosome.\n"
+				<< "\t-chromosome" <<"\n\t\tPath to saved chromosome. -use (cascade/ensemble) and -test (leaderboard) accept more of them.\n"
 				<< "\t-config" <<"\n\t\tPath to configuration file.\n"
+				<< "\t-archive" <<"\n\t\tPath to archive of alternative chromosomes (created by -harden).\n"
+				<< "\t-pareto" <<"\n\t\tMulti-objective training (error, weighted cost of active blocks, critical path depth).\n"
+				<< "\t-threads" <<"\n\t\tNumber of working threads (default: number of cores).\n"
+				<< "\t-roi" <<"\n\t\tRegions of interest for -use (one or more x,y,width,height).\n"
+				<< "\t-mask" <<"\n\t\tMask image for -use (same size as image, nonzero pixels are filtered).\n"
+				<< "\t-fill" <<"\n\t\tValue of result outside of regions of interest or mask (default: 0).\n"
+				<< "\t-combine" <<"\n\t\tCombination of results of ensemble of filters for -use: max, min, median or mean.\n"
+				<< "\t-repeat" <<"\n\t\tNumber of requests sent by -client (default: 1).\n"
+				<< "\t-size" <<"\n\t\tSize of raw grayscale frames for -stream (WIDTHxHEIGHT).\n"
 
 				<< "\t-h" <<"\n\t\tWrites help to stdout and exists the program."
 				<< std::endl;
@@ -216,6 +418,50 @@ public:
 		return chromosome;
 	}
 
+	const std::string& getChromosomePath() const {
+		return chromosomePath;
+	}
+
+	const std::vector<std::string>& getChromosomePaths() const {
+		return chromosomePaths;
+	}
+
+	const std::string& getSocket() const {
+		return socket;
+	}
+
+	const std::string& getShm() const {
+		return socket;
+	}
+
+	bool getEnsemble() const {
+		return ensemble;
+	}
+
+	CGP::Combine getCombine() const {
+		return combine;
+	}
+
+	unsigned getRepeat() const {
+		return repeat;
+	}
+
+	const std::vector<CGP::Rect>& getRois() const {
+		return rois;
+	}
+
+	const std::string& getMask() const {
+		return mask;
+	}
+
+	uint8_t getFill() const {
+		return fill;
+	}
+
+	std::ifstream& getArchive() {
+		return archive;
+	}
+
 	std::string& getOn() {
 		return on;
 	}
@@ -232,6 +478,22 @@ public:
 		return setOut;
 	}
 
+	unsigned getThreads() const {
+		return threads;
+	}
+
+	bool getPareto() const {
+		return pareto;
+	}
+
+	uint64_t getWidth() const {
+		return width;
+	}
+
+	uint64_t getHeight() const {
+		return height;
+	}
+
 private:
 
 	std::vector<std::string> set; //! Paths to images for data set.
@@ -239,7 +501,21 @@ private:
 	std::string on; //! Image path.
 	std::string out; //! Result.
 	std::ifstream chromosome; //! File containing chromosome.
+	std::string chromosomePath; //! Path to file containing chromosome.
+	std::vector<std::string> chromosomePaths; //! Paths to chromosomes (cascade of filters when there are more of them).
+	std::string socket; //! Path to socket of filter daemon or name of shared memory.
+	unsigned repeat=1; //! Number of requests sent by client.
+	bool ensemble=false; //! Chromosomes are ensemble instead of cascade.
+	CGP::Combine combine=CGP::Combine::MEDIAN; //! Combination of results of ensemble.
+	std::vector<CGP::Rect> rois; //! Regions of interest for filter.
+	std::string mask; //! Path to mask image for filter.
+	unsigned fill=0; //! Value of result outside of regions of interest/mask.
+	std::ifstream archive; //! File containing archive of chromosomes.
 	Config config; //!Loaded configuration.
+	unsigned threads=std::max(1u, std::thread::hardware_concurrency()); //! Number of working threads.
+	bool pareto=false; //! Multi-objective training.
+	uint64_t width=0; //! Width of raw frames (0 for y4m).
+	uint64_t height=0; //! Height of raw frames (0 for y4m).
 
 	Action action=Action::NOPE; //! Action user wants to perform.
 
@@ -250,16 +526,49 @@ const std::set<std::string> Args::keyWords={
 			"-damage",
 			"-test",
 			"-status",
+			"-use",
+			"-stream",
+			"-serve",
+			"-client",
+			"-repeat",
+			"-combine",
+			"-shm",
+			"-roi",
+			"-mask",
+			"-fill",
+			"-campaign",
+			"-harden",
+			"-archive",
 			"-set",
 			"-setOut",
 			"-chromosome",
 			"-on",
 			"-out",
 			"-config",
+			"-threads",
+			"-pareto",
+			"-size",
 			"-h"
 };
 const char Args::PROGRAM_NAME[]="EDEF";
 
+/**
+ * Checks extension of file (case insensitive).
+ *
+ * @param[in] path
+ * 	Path to file.
+ * @param[in] ext
+ * 	Lower case extension (with dot).
+ * @return True when path ends with given extension.
+ */
+inline bool hasExtension(const std::string& path, const std::string& ext){
+	if(path.size()<ext.size()) return false;
+	for(unsigned i=0; i<ext.size(); ++i){
+		if(std::tolower(path[path.size()-ext.size()+i])!=ext[i]) return false;
+	}
+	return true;
+}
+
 /**
  * Loads chromosome from file.
  *
@@ -280,6 +589,57 @@ inline void loadChromosome(std::ifstream& f, Chromosome& c, uint32_t& cols, uint
 
 }
 
+/**
+ * Loads chromosomes of cascade of filters.
+ *
+ * @param[in] paths
+ * 	Paths to chromosomes in order of application.
+ * @param[out] cols
+ *  Loaded number of cols (of the largest filter).
+ * @param[out] rows
+ *	Loaded number of rows (of the largest filter).
+ * @return Loaded chromosomes.
+ * @throw std::runtime_error	When chromosome could not be read.
+ */
+inline std::vector<Chromosome> loadCascade(const std::vector<std::string>& paths, uint32_t& cols, uint32_t& rows){
+	std::vector<Chromosome> cascade(paths.size());
+	cols=rows=0;
+	for(unsigned i=0; i<paths.size(); ++i){
+		std::ifstream f(paths[i], std::ios::binary);
+		uint32_t actCols=0, actRows=0;
+		loadChromosome(f, cascade[i], actCols, actRows);
+		if(!f) throw std::runtime_error("Could not read chromosome: "+paths[i]);
+		if(static_cast<uint64_t>(actCols)*actRows>static_cast<uint64_t>(cols)*rows){
+			cols=actCols;
+			rows=actRows;
+		}
+	}
+	return cascade;
+}
+
+/**
+ * Writes chromosome to stream.
+ *
+ * @param[in] f
+ * 	Output stream.
+ * @param[in] c
+ * 	Chromosome for saving.
+ * @param[in] cols
+ *  Cols for saving.
+ * @param[in] rows
+ * 	Rows for saving.
+ */
+inline void writeChromosome(std::ostream& f, const Chromosome& c, uint32_t cols, uint32_t rows){
+	uint32_t val = cols;
+	f.write(reinterpret_cast<const char *>(&val), sizeof(val));
+	val = rows;
+	f.write(reinterpret_cast<const char *>(&val), sizeof(val));
+
+	for (auto g : c) {
+		f.write(reinterpret_cast<const char *>(&g), sizeof(g));
+	}
+}
+
 /**
  * Save chromosome to file.
  *
@@ -299,34 +659,181 @@ inline void saveChromosome(std::string& path, Chromosome& c, uint32_t cols, uint
 				"Must specify chromosome file that can be open for writting.");
 	}
 
-	uint32_t val = cols;
-	f.write(reinterpret_cast<const char *>(&val), sizeof(val));
-	val = rows;
-	f.write(reinterpret_cast<const char *>(&val), sizeof(val));
+	writeChromosome(f, c, cols, rows);
+}
 
-	for (auto g : c) {
-		f.write(reinterpret_cast<const char *>(&g), sizeof(g));
+/**
+ * Loads archive of chromosomes from file.
+ * Archive starts with number of chromosomes which are stored in same format as single chromosome.
+ *
+ * @param[in] f
+ * 	File with archive.
+ * @param[out] archive
+ * 	Loaded chromosomes.
+ * @param[out] cols
+ *  Loaded number of cols.
+ * @param[out] rows
+ *	Loaded number of rows.
+ * @throw std::runtime_error When archive is invalid.
+ */
+inline void loadArchive(std::ifstream& f, Population& archive, uint32_t& cols, uint32_t& rows){
+	uint32_t size=0;
+	f.read(reinterpret_cast<char *>(&size), sizeof(size));
+	archive.resize(size);
+	for(auto& c : archive){
+		uint32_t actCols, actRows;
+		loadChromosome(f, c, actCols, actRows);
+		if(&c!=&archive[0] && (actCols!=cols || actRows!=rows)){
+			throw std::runtime_error("Invalid archive: chromosomes have different dimensions.");
+		}
+		cols=actCols;
+		rows=actRows;
+	}
+	if(!f){
+		throw std::runtime_error("Invalid archive.");
 	}
+}
 
+/**
+ * Save archive of chromosomes to file.
+ *
+ * @param[in] path
+ * 	Path to file for saving.
+ * @param[in] archive
+ * 	Chromosomes for saving.
+ * @param[in] cols
+ *  Cols for saving.
+ * @param[in] rows
+ * 	Rows for saving.
+ */
+inline void saveArchive(std::string& path, const Population& archive, uint32_t cols, uint32_t rows){
+	std::ofstream f(path, std::ios::binary);
+	if (!f) {
+		throw std::invalid_argument(
+				"Must specify archive file that can be open for writting.");
+	}
+
+	uint32_t size = archive.size();
+	f.write(reinterpret_cast<const char *>(&size), sizeof(size));
+	for (auto& c : archive) {
+		writeChromosome(f, c, cols, rows);
+	}
 }
 
 /**
- * Get indexes of damaged blocks in given chromosome.
+ * Sets function costs from configuration (if there are some).
  *
- * @param[in] c
- * 	The chromosome.
- * @return
- * 	Indexes of damaged blocks.
+ * @param[in|out] cgp
+ * 	CGP that will use the costs.
+ * @param[in] config
+ * 	The configuration.
+ * @throw std::runtime_error When costs are invalid.
  */
-inline std::set<uint32_t> getDamagedBlocks(const Chromosome& c){
-	std::set<uint32_t> damagedBlocks;
-	for (unsigned i = 2; i < c.size(); i += CGP::CHROMOSOME_BLOCK_SIZE) { //third is function
-		if (c[i] == static_cast<unsigned>(CGP::Function::DAMAGED)) {
-			damagedBlocks.insert(
-					i / CGP::CHROMOSOME_BLOCK_SIZE + CGP::PARAM_IN);
+inline void setFunctionCosts(CGP& cgp, const Config& config){
+	if(!config.getFunctionCosts().empty()){
+		if(config.getFunctionCosts().size()!=CGP::FUNCTIONS){
+			throw std::runtime_error("Invalid configuration file.\n\tFUNCTION_COSTS must contain weight for each function.");
 		}
+		cgp.setFunctionCosts(config.getFunctionCosts());
 	}
-	return damagedBlocks;
+}
+
+/**
+ * Compresses train set and sets it to CGP for evolution when compression pays off.
+ *
+ * @param[in] cgp
+ * 	CGP that will use compressed train set.
+ * @param[in] train
+ * 	Train images that will be used as input for filter.
+ * @param[in] trainOut
+ * 	Train images that will be used for filter evaluation. (Desired result)
+ * @param[out] samples
+ * 	Compressed train set. Must exist until evolution ends.
+ */
+inline void compressTrainSet(CGP& cgp, const std::vector<Image>& train, const std::vector<Image>& trainOut,
+		CGP::Samples& samples){
+	if(!CGP::compress(train, trainOut, samples)) return;
+
+	std::cout << "Train set compressed to " << samples.size() << " unique neighbourhoods." << std::endl;
+	cgp.setTrainSamples(&samples);
+}
+
+/**
+ * Sets minibatch evolution (BATCH_* keys) to CGP.
+ *
+ * @param[in] cgp
+ * 	CGP that will use minibatches.
+ * @param[in] config
+ * 	The configuration.
+ * @throw std::runtime_error When selection of tiles is invalid.
+ */
+inline void setBatch(CGP& cgp, const Config& config){
+	cgp.setBatchTiles(config.getBatchTiles());
+	cgp.setBatchReevaluate(config.getBatchReevaluate());
+	cgp.setBatchWindow(config.getBatchWindow());
+	if(config.getBatchSelection()=="random"){
+		cgp.setBatchSelection(CGP::BatchSelection::RANDOM);
+	}else if(config.getBatchSelection()=="dss"){
+		cgp.setBatchSelection(CGP::BatchSelection::DSS);
+	}else{
+		throw std::runtime_error("Invalid configuration file.\n\tBATCH_SELECTION must be one of: random, dss.");
+	}
+}
+
+/**
+ * Shrinks evolved chromosome (when SHRINK_GENERATIONS is set) and reports number of active blocks.
+ *
+ * @param[in] cgp
+ * 	CGP for shrinking.
+ * @param[in] config
+ * 	The configuration.
+ * @param[in|out] c
+ * 	Chromosome for shrinking.
+ * @param[in] train
+ * 	Train images that will be used as input for filter.
+ */
+inline void shrinkChromosome(CGP& cgp, const Config& config, Chromosome& c, const std::vector<Image>& train){
+	if(config.getShrinkGenerations()==0) return;
+
+	std::cout << "Shrink chromosome." << std::endl;
+	CGP::Cost before=cgp.cost(c);
+	c=cgp.shrink(c, config.getShrinkGenerations(), train);
+	CGP::Cost after=cgp.cost(c);
+	std::cout << "\tActive blocks: " << before.blocks << " -> " << after.blocks
+			<< ", cost: " << before.weighted << " -> " << after.weighted << std::endl;
+}
+
+/**
+ * Writes percentiles of latencies.
+ *
+ * @param[out] out
+ * 	Stream for writing.
+ * @param[in] name
+ * 	Name of measured latency.
+ * @param[in] latencies
+ * 	Latencies in milliseconds.
+ */
+inline void printLatencies(std::ostream& out, const std::string& name, std::vector<double> latencies){
+	if(latencies.empty()) return;
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile=[&](double p){
+		return latencies[static_cast<size_t>(p*(latencies.size()-1))];
+	};
+
+	out << "\t" << name << " [ms]: p50 " << percentile(0.5) << ", p90 " << percentile(0.9)
+			<< ", p99 " << percentile(0.99) << ", max " << latencies.back() << std::endl;
+}
+
+/**
+ * Peak signal-to-noise ratio of 8 bit images.
+ *
+ * @param[in] mse
+ * 	Mean squared error.
+ * @return PSNR in dB (infinity for identical images).
+ */
+inline double psnr(double mse){
+	if(mse==0) return std::numeric_limits<double>::infinity();
+	return 10*std::log10(255.0*255.0/mse);
 }
 
 int main(int argc, char* argv[]){
@@ -353,6 +860,16 @@ int main(int argc, char* argv[]){
 				cgp.setPopulationSize(config.getPopulationSize());
 				cgp.setMutationMax(config.getMaxMutations());
 				cgp.setGenerations(config.getGenerations());
+				setFunctionCosts(cgp, config);
+				setBatch(cgp, config);
+				cgp.setProbeSamples(config.getProbeSamples());
+				cgp.setProbeTolerance(config.getProbeTolerance());
+				cgp.setPyramidLevels(config.getPyramidLevels());
+				cgp.setPyramidGenerations(config.getPyramidGenerations());
+				cgp.setPyramidStagnation(config.getPyramidStagnation());
+				//population is evaluated by tiles that are split among threads
+				ThreadPool pool(myArgs.getThreads());
+				cgp.setThreadPool(&pool);
 
 				//evolve chromosome
 
@@ -371,11 +888,37 @@ int main(int argc, char* argv[]){
 				}
 				std::cout << "\tLOADED" << std::endl;
 
+				CGP::Samples samples;
+				compressTrainSet(cgp, train, trainOut, samples);
+
 				std::cout << "Start " << config.getRuns() << " evolution runs." << std::endl;
 
+				if(myArgs.getPareto()){
+					//multi-objective evolution
+					CGP::ParetoFront front=cgp.evolvePareto(config.getRuns(), train, trainOut);
+
+					//each member of the front is saved as standalone chromosome
+					std::string base(myArgs.getOut());
+					if(base.size()>4 && base.compare(base.size()-4, 4, ".bin")==0){
+						base.erase(base.size()-4);
+					}
+
+					std::cout << "Pareto front (" << front.size() << "):" << std::endl;
+					std::cout << "\tfitness\tcost\tblocks\tdepth\tfile" << std::endl;
+					for(unsigned i=0; i<front.size(); ++i){
+						std::string path(base+"_"+std::to_string(i)+".bin");
+						saveChromosome(path, front[i].chromosome, config.getCols(), config.getRows());
+						std::cout << "\t" << front[i].fitness << "\t" << front[i].cost.weighted
+								<< "\t" << front[i].cost.blocks << "\t" << front[i].cost.depth
+								<< "\t" << path << std::endl;
+					}
+					std::cout << "\tSAVED" << std::endl;
+					break;
+				}
 
 				//perform evolution
 				Chromosome c=cgp.evolve(config.getRuns(), train, trainOut);
+				shrinkChromosome(cgp, config, c, train);
 
 
 				std::cout << "Saving chromosome." << std::endl;
@@ -387,6 +930,65 @@ int main(int argc, char* argv[]){
 		case Args::Action::USE:
 			//use given filter on given image
 			{
+				bool restricted=!myArgs.getRois().empty() || !myArgs.getMask().empty();	//only part of image is filtered
+				if(restricted && myArgs.getChromosomePaths().size()>1){
+					throw std::invalid_argument("-roi and -mask can be used only with single filter.");
+				}
+				if(Batch::isDirectory(myArgs.getOn()) || hasExtension(myArgs.getOn(), ".txt")){
+					if(restricted) throw std::invalid_argument("-roi and -mask can be used only for single image.");
+					if(myArgs.getEnsemble()) throw std::invalid_argument("-combine can be used only for single image.");
+					//many images processed by pipeline
+					std::vector<Batch::Job> jobs;
+					if(Batch::isDirectory(myArgs.getOn())){
+						if(!Batch::isDirectory(myArgs.getOut())){
+							throw std::invalid_argument("-out must be directory when -on is directory.");
+						}
+						jobs=Batch::listDirectory(myArgs.getOn(), myArgs.getOut());
+					}else{
+						jobs=Batch::readManifest(myArgs.getOn(), myArgs.getOut());
+					}
+
+					std::cout << "Load chromosome." << std::endl;
+					uint32_t cols;
+					uint32_t rows;
+					std::vector<Chromosome> cascade(loadCascade(myArgs.getChromosomePaths(), cols, rows));
+					std::cout << "\tLOADED" << std::endl;
+
+					std::cout << "Apply filter on " << jobs.size() << " images." << std::endl;
+					Batch batch(cascade, cols, rows, myArgs.getThreads());
+					uint64_t failed=batch.run(jobs);
+					batch.printStats(std::cout);
+					if(failed>0){
+						std::cerr << "Failed images: " << failed << std::endl;
+						return 1;
+					}
+					break;
+				}
+
+				if(!restricted && !myArgs.getEnsemble() && hasExtension(myArgs.getOn(), ".pgm") && hasExtension(myArgs.getOut(), ".pgm")){
+					//image is streamed in bands of rows, so it does not need to fit into memory
+					std::cout << "Load chromosome." << std::endl;
+					uint32_t cols;
+					uint32_t rows;
+					std::vector<Chromosome> cascade(loadCascade(myArgs.getChromosomePaths(), cols, rows));
+					std::cout << "\tLOADED" << std::endl;
+
+					PGMReader in(myArgs.getOn());
+					PGMWriter out(myArgs.getOut(), in.getWidth(), in.getHeight());
+
+					ThreadPool pool(myArgs.getThreads());
+					CGP cgp(cols, rows);
+					cgp.setThreadPool(&pool);
+					std::cout << "Apply filter (streamed)." << std::endl;
+					if(cascade.size()==1){
+						cgp.useFilter(cascade[0], in, out);
+					}else{
+						cgp.useFilter(cascade, in, out);
+					}
+					std::cout << "\tSAVED" << std::endl;
+					break;
+				}
+
 				//load image
 				std::cout << "Load image." << std::endl;
 				Image img(myArgs.getOn());
@@ -396,19 +998,200 @@ int main(int argc, char* argv[]){
 				std::cout << "Load chromosome." << std::endl;
 				uint32_t cols;
 				uint32_t rows;
-				Chromosome c;
-				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+				std::vector<Chromosome> cascade(loadCascade(myArgs.getChromosomePaths(), cols, rows));
+				const Chromosome& c=cascade[0];
 				std::cout << "\tLOADED" << std::endl;
 
+				ThreadPool pool(myArgs.getThreads());
 				CGP cgp(cols, rows);
+				cgp.setThreadPool(&pool);
 				std::cout << "Apply filter." << std::endl;
-				Image res(cgp.useFilter(c, img));
+				Image res;
+				if(restricted){
+					CGP::Program p(CGP::compile(c));
+					std::vector<uint8_t> resPixels(img.getWidth()*img.getHeight());
+					uint64_t filtered;
+					if(myArgs.getMask().empty()){
+						filtered=cgp.useFilter(p, img.getPixels().data(), img.getWidth(), img.getHeight(),
+								myArgs.getRois(), myArgs.getFill(), resPixels.data());
+					}else{
+						Image mask(myArgs.getMask());
+						if(mask.getWidth()!=img.getWidth() || mask.getHeight()!=img.getHeight()){
+							throw std::invalid_argument("Mask must have same size as image.");
+						}
+						filtered=cgp.useFilter(p, img.getPixels().data(), img.getWidth(), img.getHeight(),
+								mask.getPixels().data(), myArgs.getFill(), resPixels.data());
+					}
+					if(!resPixels.empty()){
+						std::cout << "\tFiltered pixels: " << filtered << " (" << 100.0*filtered/resPixels.size() << " %)" << std::endl;
+					}
+					res.setData(img.getWidth(), img.getHeight(), resPixels);
+				}else if(myArgs.getEnsemble()){
+					std::vector<CGP::Program> programs;
+					for(const Chromosome& member : cascade) programs.push_back(CGP::compile(member));
+					std::vector<uint8_t> resPixels(img.getWidth()*img.getHeight());
+					cgp.useFilter(programs, myArgs.getCombine(), img.getPixels().data(), img.getWidth(), img.getHeight(),
+							resPixels.data());
+					res.setData(img.getWidth(), img.getHeight(), resPixels);
+				}else if(cascade.size()>1){
+					std::vector<CGP::Program> programs;
+					for(const Chromosome& stage : cascade) programs.push_back(CGP::compile(stage));
+					std::vector<uint8_t> resPixels(img.getWidth()*img.getHeight());
+					cgp.useFilter(programs, img.getPixels().data(), img.getWidth(), img.getHeight(), resPixels.data());
+					res.setData(img.getWidth(), img.getHeight(), resPixels);
+				}else{
+					res=cgp.useFilter(c, img);
+				}
 
 				std::cout << "Save." << std::endl;
 				res.save(myArgs.getOut());
 
 			}
 			break;
+		case Args::Action::STREAM:
+			//use given filter on frames from stdin, stdout is reserved for frames
+			{
+				uint32_t cols;
+				uint32_t rows;
+				Chromosome c;
+				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+
+				ThreadPool pool(myArgs.getThreads());
+				CGP cgp(cols, rows);
+				cgp.setThreadPool(&pool);
+				CGP::Program p(CGP::compile(c));
+
+				FrameStream stream(stdin, stdout, myArgs.getWidth(), myArgs.getHeight());
+
+				typedef std::chrono::steady_clock Clock;
+				std::vector<double> latencies;	//from read frame to written frame
+				std::vector<double> filtering;
+				uint64_t pixels=0;	//filtered pixels
+				Clock::time_point start=Clock::now();
+				while(stream.readFrame()){
+					Clock::time_point read=Clock::now();
+					if(stream.hasPrevious()){
+						//only regions that changed since previous frame
+						pixels+=cgp.useFilter(p, stream.getInput(), stream.getPrevious(), stream.getWidth(),
+								stream.getHeight(), stream.getOutput());
+					}else{
+						cgp.useFilter(p, stream.getInput(), stream.getWidth(), stream.getHeight(), stream.getOutput());
+						pixels+=stream.getWidth()*stream.getHeight();
+					}
+					Clock::time_point filtered=Clock::now();
+					stream.writeFrame();
+					Clock::time_point written=Clock::now();
+
+					filtering.push_back(std::chrono::duration<double, std::milli>(filtered-read).count());
+					latencies.push_back(std::chrono::duration<double, std::milli>(written-read).count());
+				}
+				double wall=std::chrono::duration<double>(Clock::now()-start).count();
+
+				std::cerr << "Frames: " << latencies.size() << " (" << stream.getWidth() << "x" << stream.getHeight()
+						<< (stream.isY4M() ? ", y4m" : ", raw") << ") in " << wall << " s";
+				if(wall>0) std::cerr << " (" << latencies.size()/wall << " frames/s)";
+				std::cerr << std::endl;
+				if(!latencies.empty()){
+					std::cerr << "\tFiltered pixels: "
+							<< 100.0*pixels/(latencies.size()*stream.getWidth()*stream.getHeight()) << " %" << std::endl;
+				}
+				printLatencies(std::cerr, "Frame latency", latencies);
+				printLatencies(std::cerr, "Filter", filtering);
+			}
+			break;
+		case Args::Action::SERVE:
+			{
+				Server server(myArgs.getSocket(), myArgs.getThreads());
+				std::cout << "Listening on " << myArgs.getSocket() << " (" << myArgs.getThreads() << " threads)." << std::endl;
+				server.run();
+				std::cout << "Served requests: " << server.getRequests() << std::endl;
+			}
+			break;
+		case Args::Action::CLIENT:
+			{
+				//server has different working directory
+				char* absolute=realpath(myArgs.getChromosomePath().c_str(), nullptr);
+				if(absolute==nullptr) throw std::runtime_error("Invalid path: "+myArgs.getChromosomePath());
+				std::string chromosomePath(absolute);
+				std::free(absolute);
+
+				ServerClient client(myArgs.getSocket());
+				uint64_t id=client.load(chromosomePath);
+
+				typedef std::chrono::steady_clock Clock;
+				std::vector<double> latencies;
+				if(hasExtension(myArgs.getOn(), ".pgm")){
+					PGMReader in(myArgs.getOn());
+					std::vector<uint8_t> px(in.getWidth()*in.getHeight());
+					std::vector<uint8_t> res(px.size());
+					in.readRows(px.data(), in.getHeight());
+
+					for(unsigned r=0; r<myArgs.getRepeat(); ++r){
+						Clock::time_point start=Clock::now();
+						client.filter(id, px.data(), in.getWidth(), in.getHeight(), res.data());
+						latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now()-start).count());
+					}
+
+					if(!myArgs.getOut().empty()){
+						PGMWriter out(myArgs.getOut(), in.getWidth(), in.getHeight());
+						out.writeRows(res.data(), in.getHeight());
+					}
+				}else{
+					std::ifstream f(myArgs.getOn(), std::ios::binary);
+					std::vector<uint8_t> encoded((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+					if(!f) throw std::runtime_error("Could not read: "+myArgs.getOn());
+					std::vector<uint8_t> res;
+
+					for(unsigned r=0; r<myArgs.getRepeat(); ++r){
+						Clock::time_point start=Clock::now();
+						res=client.filter(id, encoded);
+						latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now()-start).count());
+					}
+
+					if(!myArgs.getOut().empty()){
+						std::ofstream out(myArgs.getOut(), std::ios::binary);
+						if(!out.write(reinterpret_cast<const char*>(res.data()), res.size())){
+							throw std::runtime_error("Could not save image: "+myArgs.getOut());
+						}
+					}
+				}
+
+				std::cout << "Requests: " << latencies.size() << std::endl;
+				printLatencies(std::cout, "Request latency", latencies);
+			}
+			break;
+		case Args::Action::SHM:
+			{
+				uint32_t cols;
+				uint32_t rows;
+				Chromosome c;
+				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+
+				ThreadPool pool(myArgs.getThreads());
+				CGP cgp(cols, rows);
+				cgp.setThreadPool(&pool);
+				CGP::Program p(CGP::compile(c));
+
+				//status is reported to stderr as for -stream
+				ShmRing ring(myArgs.getShm());
+				std::cerr << "Attached to " << myArgs.getShm() << " (" << ring.getWidth() << "x" << ring.getHeight()
+						<< ", " << ring.getSlots() << " slots)." << std::endl;
+
+				typedef std::chrono::steady_clock Clock;
+				Clock::time_point start=Clock::now();
+				uint64_t frames=0;
+				for(uint32_t frame=ring.getFiltered(); ring.waitInput(frame); ++frame, ++frames){
+					//from input slot directly to output slot
+					cgp.useFilter(p, ring.getInput(frame), ring.getWidth(), ring.getHeight(), ring.getOutput(frame));
+					ring.publishOutput();
+				}
+				double wall=std::chrono::duration<double>(Clock::now()-start).count();
+
+				std::cerr << "Filtered frames: " << frames << " in " << wall << " s";
+				if(wall>0) std::cerr << " (" << frames/wall << " frames/s)";
+				std::cerr << std::endl;
+			}
+			break;
 		case Args::Action::REPAIR:
 			{
 				//chromosome repair
@@ -423,6 +1206,41 @@ int main(int argc, char* argv[]){
 
 				std::cout << "\tLOADED" << std::endl;
 
+				if(myArgs.getArchive().is_open()){
+					//look for alternative that does not need damaged blocks
+					std::cout << "Load archive." << std::endl;
+					Population archive;
+					uint32_t aCols=cols;
+					uint32_t aRows=rows;
+					loadArchive(myArgs.getArchive(), archive, aCols, aRows);
+					std::cout << "\tLOADED" << std::endl;
+
+					if(aCols!=cols || aRows!=rows){
+						throw std::runtime_error("Archive does not match the chromosome dimensions.");
+					}
+
+					std::set<unsigned> damagedB(CGP::damagedBlocks(c));
+					unsigned altIdx=0;
+					for(; altIdx<archive.size(); ++altIdx){
+						if(CGP::avoidsBlocks(archive[altIdx], damagedB)) break;
+					}
+
+					if(altIdx<archive.size()){
+						std::cout << "Using archived alternative: " << altIdx << std::endl;
+						Chromosome& repC=archive[altIdx];
+						//the damage stays
+						for(auto dB : damagedB){
+							CGP::damageBlock(repC, dB);
+						}
+
+						std::cout << "Saving chromosome." << std::endl;
+						saveChromosome(myArgs.getOut(), repC, cols, rows);
+						std::cout << "\tSAVED" << std::endl;
+						break;
+					}
+					std::cout << "No archived alternative avoids damaged blocks." << std::endl;
+				}
+
 				std::cout << "Used configuration: ";
 				for (auto KV : config) {
 					std::cout << KV.first << " = " << KV.second << ", ";
@@ -450,11 +1268,24 @@ int main(int argc, char* argv[]){
 				cgp.setPopulationSize(config.getPopulationSize());
 				cgp.setMutationMax(config.getMaxMutations());
 				cgp.setGenerations(config.getGenerations());
+				setFunctionCosts(cgp, config);
+				setBatch(cgp, config);
+				cgp.setProbeSamples(config.getProbeSamples());
+				cgp.setProbeTolerance(config.getProbeTolerance());
+				cgp.setPyramidLevels(config.getPyramidLevels());
+				cgp.setPyramidGenerations(config.getPyramidGenerations());
+				cgp.setPyramidStagnation(config.getPyramidStagnation());
+				//population is evaluated by tiles that are split among threads
+				ThreadPool pool(myArgs.getThreads());
+				cgp.setThreadPool(&pool);
+				CGP::Samples samples;
+				compressTrainSet(cgp, train, trainOut, samples);
 				//set damged blocks
-				cgp.setDamaged(getDamagedBlocks(c));
+				cgp.setDamaged(CGP::damagedBlocks(c));
 
 				//perform evolution
 				Chromosome repC=cgp.evolve(config.getRuns(), train, trainOut);
+				shrinkChromosome(cgp, config, repC, train);
 
 				std::cout << "Saving chromosome." << std::endl;
 				//save chromosome
@@ -476,7 +1307,7 @@ int main(int argc, char* argv[]){
 				std::cout << "\tLOADED" << std::endl;
 
 				std::vector<unsigned> blocks;
-				std::set<uint32_t> damagedBlocks(getDamagedBlocks(c));
+				std::set<unsigned> damagedBlocks(CGP::damagedBlocks(c));
 
 				//filter allready damaged blocks
 				for(unsigned idx=CGP::PARAM_IN; idx<CGP::PARAM_IN+cols*rows; ++idx){
@@ -547,7 +1378,7 @@ int main(int argc, char* argv[]){
 					std::cout << duB << " ";
 				}
 
-				std::set<uint32_t> damagedBlocks(getDamagedBlocks(c));
+				std::set<unsigned> damagedBlocks(CGP::damagedBlocks(c));
 				//damaged blocks
 				std::cout << "\nDamaged blocks ("<< damagedBlocks.size() <<"): ";
 				for(auto dB:damagedBlocks){
@@ -555,38 +1386,290 @@ int main(int argc, char* argv[]){
 				}
 				std::cout << std::endl;
 
+				//static performance profile
+				CGP cgp(cols, rows);
+				if(!config.empty()) setFunctionCosts(cgp, config);
+				CGP::Profile prof(cgp.profile(c));
+
+				std::cout << "Performance profile:\n";
+				std::cout << "\tActive blocks: " << prof.cost.blocks << "\n";
+				for(unsigned f=0; f<CGP::FUNCTIONS; ++f){
+					if(prof.histogram[f]==0) continue;
+					std::cout << "\t\t" << CGP::functionName(static_cast<CGP::Function>(f)) << ": " << prof.histogram[f] << "\n";
+				}
+				std::cout << "\tCritical path depth: " << prof.cost.depth << "\n";
+				std::cout << "\tLive intermediates: " << prof.liveIntermediates << "\n";
+				std::cout << "\tWeighted cost: " << prof.cost.weighted << "\n";
+				std::cout << "\tEstimated cycles/pixel: " << prof.cyclesPerPixel << "\n";
+				std::cout << "\tRead inputs of 3x3 window (" << prof.usedInputs.size() << "):\n";
+				for(unsigned y=0; y<3; ++y){
+					std::cout << "\t\t";
+					for(unsigned x=0; x<3; ++x){
+						std::cout << (prof.usedInputs.find(y*3+x)!=prof.usedInputs.end() ? "X " : ". ");
+					}
+					std::cout << "\n";
+				}
+				std::cout << std::flush;
+
 			}
 
 			break;
-		case Args::Action::TEST:
-			//test filter on given data
+		case Args::Action::HARDEN:
+			//build archive of alternatives
 			{
+				//load chromosome
+				std::cout << "Load chromosome." << std::endl;
+				uint32_t cols;
+				uint32_t rows;
+				Chromosome c;
+				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+				config.setCols(cols);
+				config.setRows(rows);
+				std::cout << "\tLOADED" << std::endl;
+
+				std::cout << "Used configuration: ";
+				for (auto KV : config) {
+					std::cout << KV.first << " = " << KV.second << ", ";
+				}
+				std::cout<< std::endl;
+
 				//load images
-				std::cout << "Load test set." << std::endl;
-				std::vector<Image> test;
+				std::cout << "Load train set." << std::endl;
+				std::vector<Image> train;
 				for (auto iPath : myArgs.getSet()) {
-					test.push_back(std::move(Image(iPath)));
+					train.push_back(std::move(Image(iPath)));
 				}
 				std::cout << "\tLOADED" << std::endl;
 
-				std::cout << "Load test setOut." << std::endl;
-				std::vector<Image> testOut;
+				std::cout << "Load train setOut." << std::endl;
+				std::vector<Image> trainOut;
 				for (auto iPath : myArgs.getSetOut()) {
-					testOut.push_back(std::move(Image(iPath)));
+					trainOut.push_back(std::move(Image(iPath)));
 				}
 				std::cout << "\tLOADED" << std::endl;
 
+				CGP cgp(config.getCols(), config.getRows(), config.getlBack());
+				cgp.setPopulationSize(config.getPopulationSize());
+				cgp.setMutationMax(config.getMaxMutations());
+				cgp.setGenerations(config.getGenerations());
+				CGP::Samples samples;
+				compressTrainSet(cgp, train, trainOut, samples);
+
+				uint64_t origFitness=cgp.fitness(c, train, trainOut);
+				uint64_t maxFitness=origFitness+static_cast<uint64_t>(origFitness*config.getHardenTolerance());
+				std::cout << "Fitness: " << origFitness << " (alternatives up to " << maxFitness << ")" << std::endl;
+
+				Population archive=cgp.harden(c, config.getHardenAlternatives(), maxFitness,
+						config.getRuns(), train, trainOut);
+
+				std::cout << "Found alternatives: " << archive.size() << std::endl;
+				for(unsigned i=0; i<archive.size(); ++i){
+					std::set<unsigned> usedB(CGP::usedBlocks(archive[i]));
+					std::cout << "\t" << i << ": fitness " << cgp.fitness(archive[i], train, trainOut) << ", used blocks:";
+					for(auto uB : usedB){
+						std::cout << " " << uB;
+					}
+					std::cout << std::endl;
+				}
+
+				std::cout << "Saving archive." << std::endl;
+				saveArchive(myArgs.getOut(), archive, cols, rows);
+				std::cout << "\tSAVED" << std::endl;
+			}
+			break;
+		case Args::Action::CAMPAIGN:
+			//damage x repair matrix
+			{
 				//load chromosome
 				std::cout << "Load chromosome." << std::endl;
 				uint32_t cols;
 				uint32_t rows;
 				Chromosome c;
 				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+				config.setCols(cols);
+				config.setRows(rows);
 				std::cout << "\tLOADED" << std::endl;
 
-				CGP cgp(cols, rows);
-				std::cout << "Fitness: " << std::flush;
-				std::cout << cgp.fitness(c, test, testOut) << std::endl;
+				std::cout << "Used configuration: ";
+				for (auto KV : config) {
+					std::cout << KV.first << " = " << KV.second << ", ";
+				}
+				std::cout<< std::endl;
+
+				//load images
+				std::cout << "Load train set." << std::endl;
+				std::vector<Image> train;
+				for (auto iPath : myArgs.getSet()) {
+					train.push_back(std::move(Image(iPath)));
+				}
+				std::cout << "\tLOADED" << std::endl;
+
+				std::cout << "Load train setOut." << std::endl;
+				std::vector<Image> trainOut;
+				for (auto iPath : myArgs.getSetOut()) {
+					trainOut.push_back(std::move(Image(iPath)));
+				}
+				std::cout << "\tLOADED" << std::endl;
+
+				std::ofstream csv(myArgs.getOut());
+				if(!csv){
+					throw std::invalid_argument("Must specify file that can be open for writting.");
+				}
+
+				Campaign campaign(config, c, train, trainOut);
+				std::cout << "Original fitness: " << campaign.getOriginalFitness() << std::endl;
+				std::cout << "Damage patterns: "
+						<< campaign.generatePatterns(config.getCampaignDamage(), config.getCampaignSamples())
+						<< std::endl;
+
+				std::cout << "Start repairs on " << myArgs.getThreads() << " threads." << std::endl;
+				campaign.run(myArgs.getThreads(), csv);
+				std::cout << "\tDONE" << std::endl;
+			}
+			break;
+		case Args::Action::TEST:
+			//test filter on given data
+			{
+				if(myArgs.getChromosomePaths().size()>1){
+					//leaderboard of many chromosomes, images are loaded only once and all threads share them
+					std::cout << "Load test set." << std::endl;
+					std::vector<Image> test;
+					for (auto iPath : myArgs.getSet()) {
+						test.push_back(std::move(Image(iPath)));
+					}
+					std::cout << "\tLOADED" << std::endl;
+
+					std::cout << "Load test setOut." << std::endl;
+					std::vector<Image> testOut;
+					for (auto iPath : myArgs.getSetOut()) {
+						testOut.push_back(std::move(Image(iPath)));
+					}
+					std::cout << "\tLOADED" << std::endl;
+
+					std::cout << "Load chromosomes." << std::endl;
+					uint32_t cols;
+					uint32_t rows;
+					std::vector<Chromosome> candidates(loadCascade(myArgs.getChromosomePaths(), cols, rows));
+					std::cout << "\tLOADED" << std::endl;
+
+					//all candidates are compiled before scoring, so the bad one can be reported
+					std::vector<CGP::Program> programs;
+					for(unsigned i=0; i<candidates.size(); ++i){
+						try{
+							programs.push_back(CGP::compile(candidates[i]));
+						}catch(const std::runtime_error& e){
+							throw std::runtime_error(myArgs.getChromosomePaths()[i]+": "+e.what());
+						}
+					}
+
+					std::cout << "Score " << candidates.size() << " chromosomes." << std::endl;
+					ThreadPool pool(myArgs.getThreads());
+					std::vector<CGP> scorers(pool.size(), CGP(cols, rows));
+					std::vector<std::vector<uint64_t>> errors(candidates.size());
+					pool.run(candidates.size(), [&](uint64_t task, unsigned thread){
+						errors[task]=scorers[thread].imageErrors(programs[task], test, testOut);
+					});
+
+					std::vector<uint64_t> fitness(candidates.size(), 0);
+					std::vector<unsigned> order(candidates.size());
+					for(unsigned i=0; i<candidates.size(); ++i){
+						for(uint64_t e : errors[i]) fitness[i]+=e;
+						order[i]=i;
+					}
+					std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b){
+						return fitness[a]<fitness[b];
+					});
+
+					std::cout << "rank\tfitness\tchromosome";
+					for(const std::string& iPath : myArgs.getSet()) std::cout << "\t" << iPath;
+					std::cout << std::endl;
+					for(unsigned r=0; r<order.size(); ++r){
+						std::cout << r+1 << "\t" << fitness[order[r]] << "\t" << myArgs.getChromosomePaths()[order[r]];
+						for(uint64_t e : errors[order[r]]) std::cout << "\t" << e;
+						std::cout << std::endl;
+					}
+					break;
+				}
+
+				//stdout is kept for csv when it is not written to file
+				std::ostream& status= myArgs.getOut().empty() ? std::cerr : std::cout;
+
+				//load chromosome
+				status << "Load chromosome." << std::endl;
+				uint32_t cols;
+				uint32_t rows;
+				Chromosome c;
+				loadChromosome(myArgs.getChromosome(), c, cols, rows);
+				status << "\tLOADED" << std::endl;
+				CGP::Program p(CGP::compile(c));
+
+				std::ofstream csvFile;
+				if(!myArgs.getOut().empty()){
+					csvFile.open(myArgs.getOut());
+					if(!csvFile) throw std::runtime_error("Could not create: "+myArgs.getOut());
+				}
+				std::ostream& csv= csvFile.is_open() ? csvFile : std::cout;
+
+				//pairs of images are loaded, scored and dropped by threads, so only few of them are in memory
+				const std::vector<std::string>& set=myArgs.getSet();
+				const std::vector<std::string>& setOut=myArgs.getSetOut();
+				std::vector<uint64_t> sad(set.size(), 0);	//sum of absolute differences
+				std::vector<uint64_t> sse(set.size(), 0);	//sum of squared errors
+				std::vector<uint64_t> pixels(set.size(), 0);
+				std::vector<char> scored(set.size(), 0);
+				uint64_t written=0;	//rows of csv are written in order of images
+				std::string failure;
+				std::mutex scoredMutex;
+
+				status << "Test on " << set.size() << " images." << std::endl;
+				csv << "image,sad,mse,psnr" << std::endl;
+				ThreadPool pool(myArgs.getThreads());
+				std::vector<CGP> scorers(pool.size(), CGP(cols, rows));
+				pool.run(set.size(), [&](uint64_t i, unsigned thread){
+					try{
+						Image img(set[i]);
+						Image desired(setOut[i]);
+						if(img.getWidth()!=desired.getWidth() || img.getHeight()!=desired.getHeight()){
+							throw std::runtime_error("Image and desired result have different size: "+set[i]);
+						}
+						std::vector<uint8_t> res;
+						scorers[thread].useFilter(p, img, res);
+
+						const auto& pxRight=desired.getPixels();
+						uint64_t actSad=0, actSse=0;
+						for(uint64_t j=0; j<res.size(); ++j){
+							int diff=pxRight[j]-res[j];
+							actSad+=std::abs(diff);
+							actSse+=diff*diff;
+						}
+
+						std::lock_guard<std::mutex> lock(scoredMutex);
+						sad[i]=actSad;
+						sse[i]=actSse;
+						pixels[i]=res.size();
+						scored[i]=1;
+						for(; written<set.size() && scored[written]; ++written){
+							double mse= pixels[written]>0 ? static_cast<double>(sse[written])/pixels[written] : 0;
+							csv << set[written] << "," << sad[written] << "," << mse << "," << psnr(mse) << "\n";
+						}
+					}catch(const std::exception& e){
+						std::lock_guard<std::mutex> lock(scoredMutex);
+						if(failure.empty()) failure=e.what();
+					}
+				});
+				csv << std::flush;
+				if(!failure.empty()) throw std::runtime_error(failure);
+
+				uint64_t totalSad=0, totalSse=0, totalPixels=0;
+				for(uint64_t i=0; i<set.size(); ++i){
+					totalSad+=sad[i];
+					totalSse+=sse[i];
+					totalPixels+=pixels[i];
+				}
+				double mse= totalPixels>0 ? static_cast<double>(totalSse)/totalPixels : 0;
+				status << "Fitness: " << totalSad << std::endl;
+				status << "MSE: " << mse << std::endl;
+				status << "PSNR: " << psnr(mse) << " dB" << std::endl;
 			}
 			break;
 		default:
@@ -601,14 +1684,13 @@ int main(int argc, char* argv[]){
 		std::cerr << "Arguments error: \n";
 		std::cerr << "\t" << e.what() << "\n\n";
 
-		Args::showHelp();
+		//stdout can carry frames (-stream)
+		Args::showHelp(std::cerr);
 
 		return 1;
 	} catch (const std::runtime_error& e) {
 		std::cerr << "Runtime error: \n";
-		std::cerr << e.what() << "\n\n";
-
-		Args::showHelp();
+		std::cerr << e.what() << std::endl;
 
 		return 1;
 	}